@@ -97,6 +97,115 @@ inline unsigned long getCheapEntropy()
 
 //----------------------------------------------------------------------------
 
+// The Arduino random() function is slow on an AVR:  each call does two
+// 32-bit divisions to make the next number, and one more to fit it into
+// the range asked for.  These xorshift generators only shift and XOR
+// their state, which is a small fraction of the work.  They are fine for
+// sparkles and other visual effects, but not for anything like security.
+//
+//   FastRandom32 sparkle;
+//   sparkle.setSeed(getCheapEntropy());
+//   int brightness = sparkle.between(150, 255);
+//
+// FastRandom16 is faster still, but repeats itself after 65535 numbers;
+// FastRandom32 repeats after about four billion.
+//
+// A number is fit into a range by multiplying it by the size of the
+// range and keeping the high half, instead of dividing (the remainder
+// method of random()).  Some numbers would come up slightly more often
+// than others, so those rare cases are thrown away and drawn again; this
+// needs one division, and only happens about range/65536 of the time.
+//
+inline uint16_t xorshift(uint16_t x)
+{
+  x ^= x << 7;
+  x ^= x >> 9;
+  x ^= x << 8;
+  return x;
+}
+
+inline uint32_t xorshift(uint32_t x)
+{
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+template <typename STATE>
+class FastRandom
+{
+public:
+  FastRandom(uint32_t seed = 1) { setSeed(seed); }
+
+  // A zero state would never change, so it is replaced.
+  void setSeed(uint32_t seed)
+  {
+    state = (STATE)(seed ^ (seed >> 16));
+    if (!state)
+      state = 0xACE1;
+  }
+
+  uint16_t next16()
+  {
+    state = xorshift(state);
+    return state >> (sizeof(STATE)*8 - 16);
+  }
+
+  uint8_t next8() { return next16() >> 8; }
+
+  // A number from 0 to range-1.
+  uint16_t below(uint16_t range)
+  {
+    uint32_t product = (uint32_t)next16() * range;
+    uint16_t low = product;
+    if (low < range)
+    {
+      uint16_t threshold = (uint16_t)(0 - range) % range;
+      while (low < threshold)
+      {
+        product = (uint32_t)next16() * range;
+        low = product;
+      }
+    }
+    return product >> 16;
+  }
+
+  // A number from 0 to range-1, with only an 8-bit multiply.
+  uint8_t below8(uint8_t range)
+  {
+    uint16_t product = (uint16_t)next8() * range;
+    uint8_t low = product;
+    if (low < range)
+    {
+      uint8_t threshold = (uint8_t)(0 - range) % range;
+      while (low < threshold)
+      {
+        product = (uint16_t)next8() * range;
+        low = product;
+      }
+    }
+    return product >> 8;
+  }
+
+  // A number from least to most-1, like random(least, most).  The range
+  // must be no more than 65535.
+  long between(long least, long most)
+  {
+    if (least >= most)
+      return least;
+    return least + below(most - least);
+  }
+
+private:
+  STATE state;
+};
+
+typedef FastRandom<uint16_t> FastRandom16;
+typedef FastRandom<uint32_t> FastRandom32;
+
+//----------------------------------------------------------------------------
+
 // Retrieve a value INPUT, INPUT_PULLUP, or OUTPUT, from the current
 // pin setting.
 //
@@ -138,6 +247,278 @@ inline bool isButtonPressed(uint8_t pin)
 
 //----------------------------------------------------------------------------
 
+// The functions above look up each pin's port and bit in tables, every
+// time they're called.  When the pin numbers are known at compile time,
+// the compiler can work all of that out ahead of time instead.  On the
+// ATmega328 boards (Uno, Nano, Pro Mini), pins 0~7 are bits 0~7 of port
+// D, pins 8~13 are bits 0~5 of port B, and pins 14~19 (A0~A5) are bits
+// 0~5 of port C.  On other boards, these fall back to digitalRead().
+//
+//   if (FastPin<4>::read()) ...
+//
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || \
+    defined(__AVR_ATmega168__)
+  #define GENERIC_FAST_PINS
+#endif
+
+template <uint8_t PIN>
+struct FastPin
+{
+  enum
+  {
+    BIT = (PIN < 8)? PIN : (PIN < 14)? PIN - 8 : PIN - 14,
+    MASK = 1 << BIT,
+    B_MASK = (PIN >= 8 && PIN < 14)? MASK : 0,
+    C_MASK = (PIN >= 14)? MASK : 0,
+    D_MASK = (PIN < 8)? MASK : 0,
+  };
+
+  static bool read()
+  {
+#ifdef GENERIC_FAST_PINS
+    static_assert(PIN < 20, "not a digital pin on this board");
+    // Only the one port this pin is on is read.
+    return ((PIN < 8)? PIND : (PIN < 14)? PINB : PINC) & MASK;
+#else
+    return digitalRead(PIN);
+#endif
+  }
+
+  // Find this pin's bit among snapshots of the three ports.
+  static uint8_t pick(uint8_t b, uint8_t c, uint8_t d)
+  {
+    return ((PIN < 8)? d : (PIN < 14)? b : c) & MASK;
+  }
+};
+
+template <uint8_t... PINS>
+struct FastPinList;
+
+template <>
+struct FastPinList<>
+{
+  enum { B_MASK = 0, C_MASK = 0, D_MASK = 0 };
+  static uint8_t gather(uint8_t, uint8_t, uint8_t) { return 0; }
+  static uint8_t readEach() { return 0; }
+};
+
+template <uint8_t PIN, uint8_t... REST>
+struct FastPinList<PIN, REST...>
+{
+  enum
+  {
+    B_MASK = FastPin<PIN>::B_MASK | FastPinList<REST...>::B_MASK,
+    C_MASK = FastPin<PIN>::C_MASK | FastPinList<REST...>::C_MASK,
+    D_MASK = FastPin<PIN>::D_MASK | FastPinList<REST...>::D_MASK,
+  };
+
+  // A pressed button pulls its pin low.
+  static uint8_t gather(uint8_t b, uint8_t c, uint8_t d)
+  {
+    uint8_t pressed = FastPin<PIN>::pick(b, c, d)? 0 : 1 << sizeof...(REST);
+    return pressed | FastPinList<REST...>::gather(b, c, d);
+  }
+
+  // The same, reading one pin at a time.
+  static uint8_t readEach()
+  {
+    uint8_t pressed = FastPin<PIN>::read()? 0 : 1 << sizeof...(REST);
+    return pressed | FastPinList<REST...>::readEach();
+  }
+};
+
+// A bank of INPUT_PULLUP buttons, read together as one number.  The first
+// pin given is the highest bit, and a bit is 1 while that button is
+// pressed.  Each port that has any of the buttons is read only once, so
+// all the buttons are sampled at the same instant, in a few cycles.
+//
+//   ButtonBank<9, 8, 7> buttons;
+//   int vector = buttons.read();  // 4 if only pin 9 is pressed
+//
+template <uint8_t... PINS>
+struct ButtonBank
+{
+  typedef FastPinList<PINS...> List;
+
+  static uint8_t read()
+  {
+#ifdef GENERIC_FAST_PINS
+    // The masks are known when compiled, so a port with none of the
+    // buttons is never read at all.
+    uint8_t b = (List::B_MASK != 0)? PINB : 0;
+    uint8_t c = (List::C_MASK != 0)? PINC : 0;
+    uint8_t d = (List::D_MASK != 0)? PIND : 0;
+    return List::gather(b, c, d);
+#else
+    return List::readEach();
+#endif
+  }
+};
+
+//----------------------------------------------------------------------------
+
+// A queue for passing small events from an interrupt handler to the main
+// loop() without ever disabling interrupts.  Only the interrupt handler
+// calls push(), and only the main loop() calls pop().  Each side only
+// changes its own index, and a single byte is always read or written in
+// one instruction, so neither side can see the other half-way through a
+// change.  SIZE must be a power of two, no more than 128; one slot is
+// always left empty to tell a full queue from an empty one.
+//
+//   struct Event { unsigned long millis; uint8_t data; };
+//   EventQueue<Event, 8> events;
+//
+//   ISR(...) { Event e = { millis(), PINB }; events.push(e); }
+//
+//   Event e;                  // then, in loop():
+//   while (events.pop(e))
+//     handle(e);
+//
+template <typename T, uint8_t SIZE>
+class EventQueue
+{
+public:
+  EventQueue() : head(0), tail(0) { ; }
+
+  // Returns false, and drops the event, if the queue is full.
+  bool push(const T& event)
+  {
+    uint8_t next = (head + 1) & (SIZE - 1);
+    if (next == tail)
+      return false;
+    items[head] = event;
+    // The event must be stored before the consumer can see the new head.
+    asm volatile("" ::: "memory");
+    head = next;
+    return true;
+  }
+
+  // Returns false if the queue is empty.
+  bool pop(T& event)
+  {
+    if (tail == head)
+      return false;
+    // Only read the event after seeing the head, and before giving the
+    // slot back to the producer.
+    asm volatile("" ::: "memory");
+    event = items[tail];
+    asm volatile("" ::: "memory");
+    tail = (tail + 1) & (SIZE - 1);
+    return true;
+  }
+
+  bool isEmpty() const { return head == tail; }
+
+private:
+  T items[SIZE];
+  volatile uint8_t head;
+  volatile uint8_t tail;
+};
+
+//----------------------------------------------------------------------------
+
+// An analog input, such as a knob, which is read in the background instead
+// of waiting about 110us for each analogRead().  Once begun, the ADC
+// converts the channel by itself every time timer 0 overflows (every
+// 1024us on a 16MHz Arduino, the same timer used by millis()), and the
+// sketch's ADC interrupt hands each result to sample():
+//
+//   AnalogFilter knob;
+//   ISR(ADC_vect) { knob.sample(ADC); }
+//
+//   knob.begin(0);            // in setup(), for pin A0, then in loop():
+//   if (knob.hasChanged())
+//     level = knob.read();
+//
+// The samples are smoothed by averaging about the last 2^SHIFT of them.
+// The value read only moves when the average has moved by more than the
+// hysteresis, or reaches either end of the range, so the jitter of the
+// ADC doesn't make the value flicker back and forth.
+//
+// While the sampler runs, analogRead() can't be used.  Call stop() first,
+// and begin() again afterward.  Without an ADC interrupt (or on other
+// boards), call sample() with the results of analogRead() instead.
+//
+class AnalogFilter
+{
+public:
+  AnalogFilter(uint8_t shift = 3, uint8_t hysteresis = 4) :
+    shift(shift), hysteresis(hysteresis), sum(0), value(0),
+    primed(false), changed(false) { ; }
+
+  void begin(uint8_t channel)
+  {
+#ifdef ADCSRA
+    ADMUX = (1 << REFS0) | (channel & 0x07);
+    ADCSRB = (1 << ADTS2);
+    ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | (1 << ADIF) |
+             (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+#endif
+  }
+
+  void stop()
+  {
+#ifdef ADCSRA
+    ADCSRA &= ~((1 << ADATE) | (1 << ADIE));
+    while (ADCSRA & (1 << ADSC))
+      ;
+    ADCSRB = 0;
+#endif
+  }
+
+  // Add one 10-bit sample.  Usually called by the ADC interrupt.  The
+  // first sample is taken as the value at once, even one within the
+  // hysteresis of 0, so that it is always reported as a change.
+  void sample(uint16_t raw)
+  {
+    if (!primed)
+    {
+      sum = raw << shift;
+      value = raw;
+      changed = true;
+      primed = true;
+      return;
+    }
+    sum += raw - (sum >> shift);
+    uint16_t average = sum >> shift;
+    bool moved = (average > value + hysteresis) ||
+                 (average + hysteresis < value) ||
+                 (average != value && (average == 0 || average == 1023));
+    if (moved)
+    {
+      value = average;
+      changed = true;
+    }
+  }
+
+  uint16_t read() const
+  {
+    noInterrupts();
+    uint16_t v = value;
+    interrupts();
+    return v;
+  }
+
+  // True once after each change in the value.
+  bool hasChanged()
+  {
+    if (!changed)
+      return false;
+    changed = false;
+    return true;
+  }
+
+private:
+  uint8_t shift;
+  uint8_t hysteresis;
+  uint16_t sum;
+  volatile uint16_t value;
+  bool primed;
+  volatile bool changed;
+};
+
+//----------------------------------------------------------------------------
+
 // Count the number of 1-bits in the given long integer.
 //
 inline int countBits(unsigned long i)
@@ -174,6 +555,443 @@ inline unsigned long reverseBits(unsigned long i)
   return r;
 }
 
+// Transpose an 8x8 block of bits.  Given one byte from each of eight
+// rows, this gives the eight bit-planes, most significant bit first:  bit
+// n of out[k] is bit (7-k) of in[n].  This is how the bytes of several
+// pixel strands are turned into the values to write to one port, so all
+// the strands receive their bits at the same time (see NeoLanes in
+// NeoStrand.h).  The input and output may not be the same array.
+//
+inline void transposeBits(const uint8_t* in, uint8_t* out)
+{
+  uint8_t rows[8];
+  memcpy(rows, in, 8);
+  for (uint8_t k = 0; k < 8; k++)
+  {
+    uint8_t plane = 0;
+    for (uint8_t n = 8; n--; )
+    {
+      plane = (plane << 1) | (rows[n] >> 7);
+      rows[n] <<= 1;
+    }
+    out[k] = plane;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+// A cooperative task is a function that does a little bit of its work
+// each time it is called, then returns so the rest of the sketch can run,
+// and picks up where it left off on the next call.  This lets a long
+// animation be written as one simple function with loops and waits, but
+// without blocking the main loop() the way delay() does.
+//
+//   Task blink;
+//   bool stepBlink()
+//   {
+//     TASK_BEGIN(blink);
+//     digitalWrite(13, HIGH);
+//     TASK_DELAY(blink, 500);
+//     digitalWrite(13, LOW);
+//     TASK_END(blink);
+//   }
+//
+//   blink.start();            // then, in every loop():
+//   if (blink.isRunning())
+//     stepBlink();
+//
+// The task function returns false while it still has work to do, and
+// true when it reaches TASK_END.  The waiting macros work by remembering
+// the source line and jumping back into the middle of the function with a
+// switch statement, so local variables don't survive from one call to the
+// next; keep any state in static or global variables.  For the same
+// reason, don't declare initialized local variables between TASK_BEGIN
+// and TASK_END, and don't use two waiting macros on one line.
+//
+struct Task
+{
+  Task() : line(-1), wake(0) { ; }
+  void start() { line = 0; }
+  void stop() { line = -1; }
+  bool isRunning() const { return line >= 0; }
+
+  int line;
+  unsigned long wake;
+};
+
+#define TASK_BEGIN(task) \
+  switch ((task).line) { case 0:
+
+// Return now, and continue after this point on the next call.
+#define TASK_YIELD(task) \
+  do { (task).line = __LINE__; return false; case __LINE__:; } while (0)
+
+// Return on every call until the condition is true, then continue.
+#define TASK_WAIT_UNTIL(task, condition) \
+  do { (task).line = __LINE__; case __LINE__: \
+       if (!(condition)) return false; } while (0)
+
+// Return on every call until some milliseconds have passed, then continue.
+#define TASK_DELAY(task, ms) \
+  do { (task).wake = millis() + (ms); (task).line = __LINE__; case __LINE__: \
+       if ((long)(millis() - (task).wake) < 0) return false; } while (0)
+
+#define TASK_END(task) \
+  } (task).line = -1; return true;
+
+//----------------------------------------------------------------------------
+
+// A gesture is a pattern of button presses and releases over time, such
+// as a double-tap, or holding a button down.  The recognizer keeps a short
+// history of input vectors (a number for each combination of buttons),
+// and how long each one was held.  Gestures are described by tables of
+// steps, matched against that history from the most recent change back.
+//
+// Each step gives an input vector, and the shortest and longest time it
+// can be held, in 10ms units (use GESTURE_MS()).  A longest time of 0
+// means no limit.  The vector GESTURE_TAP stands for any buttons at all,
+// as long as every GESTURE_TAP step in the gesture is the same buttons.
+// A gesture which is steady also needs every tap to take about the same
+// time, from one press to the next, within that many 10ms units.
+//
+//   const Gesture gestures[] PROGMEM =
+//   {
+//     // double-tap any buttons, released within half a second
+//     { DOUBLE, 0, 4, { { 0, 0, 0 }, { GESTURE_TAP, 0, 0 },
+//                       { 0, 0, GESTURE_MS(500) }, { GESTURE_TAP, 0, 0 } } },
+//     // tap, then press again and hold for a second
+//     { TAPHOLD, 0, 3, { { GESTURE_TAP, GESTURE_MS(1000), 0 },
+//                        { 0, 0, 0 }, { GESTURE_TAP, 0, 0 } } },
+//     // button 4, then button 1, then release
+//     { COMBO, 0, 3, { { 0, 0, 0 }, { 1, 0, 0 }, { 4, 0, 0 } } },
+//   };
+//   GestureRecognizer<6> recognizer(gestures);
+//
+// Call record() in every loop() with the current input vector, then
+// recognize() to see which gesture, if any, is being done.  The earlier
+// gestures in the table are preferred.
+//
+// Everything but the time of the most recent entry is settled as soon as
+// the input changes, so the whole table is only checked then.  The
+// gestures which match so far are remembered, and each frame only those
+// wait for the latest entry to be held for long enough.
+//
+#define GESTURE_STEPS 6
+#define GESTURE_TAP 0xFF
+#define GESTURE_MS(ms) ((ms)/10)
+
+struct GestureStep
+{
+  uint8_t vector;     // an input vector, or GESTURE_TAP
+  uint8_t least;      // shortest time held, in 10ms units
+  uint8_t most;       // longest time held, in 10ms units, or 0 for no limit
+};
+
+struct Gesture
+{
+  uint8_t result;     // what recognize() returns for this gesture
+  uint8_t steady;     // how close the taps' times must be, in 10ms units
+  uint8_t length;     // how many steps are used
+  GestureStep steps[GESTURE_STEPS];   // most recent first
+};
+
+template <uint8_t LENGTH>
+class GestureRecognizer
+{
+public:
+  // The table is kept in PROGMEM, and may hold up to 16 gestures, one
+  // for each bit of the armed mask.
+  template <size_t COUNT>
+  GestureRecognizer(const Gesture (&gestures)[COUNT]) :
+    table(gestures), count(COUNT)
+  {
+    static_assert(COUNT <= 16, "a GestureRecognizer holds up to 16 gestures");
+    clear(0);
+  }
+
+  // Forget all the input history, as if nothing were pressed since now.
+  void clear(unsigned long now)
+  {
+    memset(vectors, 0, sizeof(vectors));
+    memset(times, 0, sizeof(times));
+    head = 0;
+    changed = now;
+    armed = 0;
+  }
+
+  // Record the current input vector.  If it differs from the latest one,
+  // the latest one is ended at the given time when the input changed.
+  void record(uint8_t vector, unsigned long when)
+  {
+    if (vector == vectors[head])
+      return;
+    if ((long)(when - changed) < 0)
+      when = changed;
+    unsigned long held = when - changed;
+    times[head] = (held > 0xFFFF)? 0xFFFF : held;
+    head = (head + 1 < LENGTH)? head + 1 : 0;
+    vectors[head] = vector;
+    times[head] = 0;
+    changed = when;
+    arm();
+  }
+
+  // Find the first gesture which matches, now that the latest entry has
+  // been held for a while.  Returns 0 if none match.
+  uint8_t recognize(unsigned long now)
+  {
+    unsigned long held = now - changed;
+    for (uint8_t g = 0; armed >> g; g++)
+    {
+      if (!(armed & (1U << g)))
+        continue;
+      const GestureStep* step = &table[g].steps[0];
+      unsigned long most = pgm_read_byte(&step->most) * 10UL;
+      if (most && held > most)
+      {
+        armed &= ~(1U << g);
+        continue;
+      }
+      if (held >= pgm_read_byte(&step->least) * 10UL)
+        return pgm_read_byte(&table[g].result);
+    }
+    return 0;
+  }
+
+  // The history, where entry 0 is the latest input vector, and its time is
+  // how long it has been held so far.  Times are in milliseconds.
+  uint8_t getVector(uint8_t i) const { return vectors[index(i)]; }
+  unsigned long getTime(uint8_t i) const
+  {
+    return i? times[index(i)] : millis() - changed;
+  }
+
+  // When the latest input vector started.
+  unsigned long getMillis() const { return changed; }
+
+private:
+  uint8_t index(uint8_t i) const
+  {
+    return (head >= i)? head - i : head + LENGTH - i;
+  }
+
+  void arm()
+  {
+    armed = 0;
+    for (uint8_t g = 0; g < count; g++)
+    {
+      Gesture gesture;
+      memcpy_P(&gesture, &table[g], sizeof(gesture));
+      if (matches(gesture))
+        armed |= 1U << g;
+    }
+  }
+
+  // Check every step but the time of the latest entry.
+  bool matches(const Gesture& gesture) const
+  {
+    if (gesture.length > LENGTH || gesture.length > GESTURE_STEPS)
+      return false;
+    uint8_t tap = 0;
+    for (uint8_t i = 0; i < gesture.length; i++)
+    {
+      const GestureStep& step = gesture.steps[i];
+      uint8_t vector = getVector(i);
+      if (step.vector == GESTURE_TAP)
+      {
+        if (!vector || (tap && vector != tap))
+          return false;
+        tap = vector;
+      }
+      else if (vector != step.vector)
+        return false;
+      if (!i)
+        continue;
+      unsigned long time = times[index(i)];
+      if (time < step.least * 10UL)
+        return false;
+      if (step.most && time > step.most * 10UL)
+        return false;
+    }
+    return !gesture.steady || isSteady(gesture);
+  }
+
+  // Compare the time from each tap to the next, with the first one.
+  bool isSteady(const Gesture& gesture) const
+  {
+    long first = -1;
+    for (uint8_t i = 1; i + 1 < gesture.length; i++)
+    {
+      if (gesture.steps[i].vector != GESTURE_TAP)
+        continue;
+      long period = (long)times[index(i)] + times[index(i+1)];
+      if (first < 0)
+        first = period;
+      else if (labs(period - first) > gesture.steady * 10L)
+        return false;
+    }
+    return true;
+  }
+
+  const Gesture* table;
+  uint8_t count;
+  uint8_t vectors[LENGTH];
+  uint16_t times[LENGTH];
+  uint8_t head;
+  unsigned long changed;
+  uint16_t armed;
+};
+
+//----------------------------------------------------------------------------
+
+// A frame clock paces the main loop() at a steady rate, so that anything
+// counted in frames runs at the same speed no matter how long the strand
+// is, or how much work each frame happens to take.  Call waitForFrame()
+// at the start of every loop(); it waits until the next frame is due.
+// The rate is in frames per second, and a rate of 0 is taken as 1.
+//
+// Showing the strand right after waiting, before the frame's own work,
+// puts each frame on the strand at a steady time, whatever that work
+// takes.  The frame shown is then the one worked out in the loop() before,
+// so everything appears one frame period late.
+//
+// Sending data to a NeoPixel strand disables interrupts, and the Arduino
+// millis() and micros() clocks only count one timer overflow (1024us)
+// while interrupts are disabled, no matter how long that takes.  After a
+// long show(), tell the clock how much time micros() missed with
+// compensate(), and it will add that time to its own clock.
+//
+// The clock also keeps statistics about the time each frame was busy
+// before it had to wait, and counts the frames which took longer than
+// the frame period (overruns).  If the loop falls more than a whole frame
+// behind, the clock skips ahead rather than rushing to catch up.
+//
+class FrameClock
+{
+public:
+  FrameClock(unsigned int rate) :
+    offset(0), deadline(0), frameStart(0), started(false)
+  {
+    setRate(rate);
+    resetStats();
+  }
+
+  void setRate(unsigned int rate) { period = 1000000UL / (rate? rate : 1); }
+  unsigned long getPeriod() const { return period; }
+
+  // The micros() clock, plus the time it missed during show() calls.
+  unsigned long now() const { return micros() + offset; }
+
+  void compensate(unsigned long missed) { offset += missed; }
+
+  void waitForFrame()
+  {
+    unsigned long t = now();
+    if (!started)
+    {
+      started = true;
+      deadline = t;
+    }
+    else
+    {
+      unsigned long busy = t - frameStart;
+      if (busy < minBusy)
+        minBusy = busy;
+      if (busy > maxBusy)
+        maxBusy = busy;
+      totalBusy += busy;
+      frames++;
+      if (busy > period)
+        overruns++;
+      deadline += period;
+      if ((long)(t - deadline) > (long)period)
+        deadline = t;
+    }
+    while ((long)(now() - deadline) < 0)
+      ;
+    frameStart = now();
+  }
+
+  // Statistics about the busy time of each frame, in microseconds.
+  unsigned long getMinMicros() const { return frames? minBusy : 0; }
+  unsigned long getMaxMicros() const { return maxBusy; }
+  unsigned long getMeanMicros() const { return frames? totalBusy / frames : 0; }
+  unsigned long getFrames() const { return frames; }
+  unsigned long getOverruns() const { return overruns; }
+
+  void resetStats()
+  {
+    minBusy = 0xFFFFFFFFUL;
+    maxBusy = 0;
+    totalBusy = 0;
+    frames = 0;
+    overruns = 0;
+  }
+
+private:
+  unsigned long period;
+  unsigned long offset;
+  unsigned long deadline;
+  unsigned long frameStart;
+  bool started;
+
+  unsigned long minBusy;
+  unsigned long maxBusy;
+  unsigned long totalBusy;
+  unsigned long frames;
+  unsigned long overruns;
+};
+
+//----------------------------------------------------------------------------
+
+// A scroll clock turns the time that has passed into motion at a steady
+// speed in pixels per second, however often it is asked.  The position is
+// kept in fixed point (millionths of a pixel), so any speed moves evenly,
+// even one which doesn't divide into the frame rate.  Each frame, call
+// advance() with the time in microseconds, such as FrameClock::now(); it
+// returns how many whole pixels to scroll.  Then fraction() tells how far
+// the next pixel has come in (0~255), for drawing it partly faded in.
+//
+// A long pause (more than 50ms, such as before the first frame) only
+// counts as 50ms, so the motion never lurches ahead by a large amount.
+//
+class ScrollClock
+{
+public:
+  ScrollClock(unsigned int pixelsPerSecond) :
+    speed(pixelsPerSecond), last(0), residue(0) { ; }
+
+  void setSpeed(unsigned int pixelsPerSecond) { speed = pixelsPerSecond; }
+  unsigned int getSpeed() const { return speed; }
+
+  void start(unsigned long now)
+  {
+    last = now;
+    residue = 0;
+  }
+
+  unsigned int advance(unsigned long now)
+  {
+    unsigned long elapsed = now - last;
+    last = now;
+    if (elapsed > 50000UL)
+      elapsed = 50000UL;
+    residue += elapsed * speed;
+    unsigned int steps = residue / 1000000UL;
+    residue -= steps * 1000000UL;
+    return steps;
+  }
+
+  // The part of a pixel moved since the last whole step, 256ths of a
+  // pixel (1000000/256 is 15625/4).
+  uint8_t fraction() const { return (residue * 4) / 15625; }
+
+private:
+  unsigned int speed;
+  unsigned long last;
+  unsigned long residue;
+};
+
 //----------------------------------------------------------------------------
 
 #endif // __GENERIC_H__
@@ -14,12 +14,75 @@
 #define __NEOSTRAND_H__
 
 #include <Adafruit_NeoPixel.h>
+#include "Generic.h"
 #ifdef __AVR__
   #include <avr/power.h>
 #endif
 
 //----------------------------------------------------------------------------
 
+// The colors used by a strand which stores one palette index per pixel
+// instead of the color bytes.  See NeoStrandIndexed below.
+//
+struct NeoPalette
+{
+  uint8_t* colors;       // size entries, each in the strand's byte order
+  uint8_t* marks;        // one bit per entry which may be in use
+  uint16_t size;         // 16 or 256 entries
+  uint8_t epoch;         // counts how often entries were reclaimed or faded
+  uint8_t lastIndex;     // the entry last matched, and its color
+  uint32_t lastColor;
+};
+
+//----------------------------------------------------------------------------
+
+// For NeoStrand::ColorHSV(), the job of the red, green and blue channels
+// in each sixth of the color wheel, two bits each:  0 is off, 1 rising,
+// 2 falling, 3 fully on.
+//
+static const uint8_t NeoHSVSectors[6] PROGMEM =
+{
+  (3<<4) | (1<<2) | 0,    // red to yellow
+  (2<<4) | (3<<2) | 0,    // yellow to green
+  (0<<4) | (3<<2) | 1,    // green to cyan
+  (0<<4) | (2<<2) | 3,    // cyan to blue
+  (1<<4) | (0<<2) | 3,    // blue to magenta
+  (3<<4) | (0<<2) | 2,    // magenta to red
+};
+
+//----------------------------------------------------------------------------
+
+// For NeoStrand::setGamma(), the byte actually sent for each byte in the
+// pixel buffer:  255 * (value/255)^2.6, the same curve Adafruit uses.
+//
+static const uint8_t NeoGammaTable[256] PROGMEM =
+{
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+    2,   2,   2,   2,   2,   2,   2,   2,   3,   3,   3,   3,
+    3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   5,   6,
+    6,   6,   6,   7,   7,   7,   8,   8,   8,   9,   9,   9,
+   10,  10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,
+   14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,  20,
+   20,  21,  21,  22,  22,  23,  24,  24,  25,  25,  26,  27,
+   27,  28,  29,  29,  30,  31,  31,  32,  33,  34,  34,  35,
+   36,  37,  38,  38,  39,  40,  41,  42,  42,  43,  44,  45,
+   46,  47,  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,
+   58,  59,  60,  61,  62,  63,  64,  65,  66,  68,  69,  70,
+   71,  72,  73,  75,  76,  77,  78,  80,  81,  82,  84,  85,
+   86,  88,  89,  90,  92,  93,  94,  96,  97,  99, 100, 102,
+  103, 105, 106, 108, 109, 111, 112, 114, 115, 117, 119, 120,
+  122, 124, 125, 127, 129, 130, 132, 134, 136, 137, 139, 141,
+  143, 145, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164,
+  166, 168, 170, 172, 174, 176, 178, 180, 182, 184, 186, 188,
+  191, 193, 195, 197, 199, 202, 204, 206, 209, 211, 213, 215,
+  218, 220, 223, 225, 227, 230, 232, 235, 237, 240, 242, 245,
+  247, 250, 252, 255,
+};
+
+//----------------------------------------------------------------------------
+
 // Extends the core Adafruit_NeoPixel class with some additional useful
 // capabilities.  Some of these features are also found in the alternate
 // library called FastLED, but this example shows how you can cleanly
@@ -29,12 +92,226 @@ class NeoStrand : public Adafruit_NeoPixel
 {
 public:
   NeoStrand(uint16_t n, uint8_t p=6, neoPixelType t=NEO_GRB + NEO_KHZ800) :
-    Adafruit_NeoPixel(n, p, t) { ; }
+    Adafruit_NeoPixel(n, p, t), head(0), ring(false), partial(false),
+    changedEnd(n), palette(NULL), gamma(false), powerBudget(0),
+    powerChannel(20), powerLimit(255), powerLevels(0), lastSum(0),
+    shownFrames(0), skippedFrames(0), partialFrames(0), showMicros(0),
+    stalledMicros(0), wipeNext(0xFFFF), wipeWait(0), wipeWake(0) { ; }
   NeoStrand(void) :
-    Adafruit_NeoPixel() { ; }
+    Adafruit_NeoPixel(), head(0), ring(false), partial(false),
+    changedEnd(0), palette(NULL), gamma(false), powerBudget(0),
+    powerChannel(20), powerLimit(255), powerLevels(0), lastSum(0),
+    shownFrames(0), skippedFrames(0), partialFrames(0), showMicros(0),
+    stalledMicros(0), wipeNext(0xFFFF), wipeWait(0), wipeWake(0) { ; }
 
 public:
 
+  // A strand normally stores pixel 0 at the start of the pixel buffer, so
+  // scrolling has to move every byte of the buffer.  In ring buffer mode,
+  // the strand instead remembers which byte of the buffer holds pixel 0,
+  // and scrolling just moves that head offset around the ring.  This makes
+  // scrollForward() and scrollBackward() take the same short time no matter
+  // how long the strand is.
+  //
+  // The pixel numbers given to setPixelColor() and getPixelColor() are the
+  // same in either mode, but the raw buffer from getPixels() is rotated in
+  // ring buffer mode.  Turning the mode off puts the buffer back in order.
+  //
+  void setRingBuffer(bool enable)
+  {
+    if (!enable)
+      unrotate();
+    ring = enable;
+  }
+  bool isRingBuffer() const { return ring; }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b)
+  {
+    if (palette)
+    {
+      setPixelColor(n, Color(r, g, b));
+      return;
+    }
+    changeThrough(n);
+    forgetLevel(n);
+    Adafruit_NeoPixel::setPixelColor(physical(n), r, g, b);
+    countLevel(n);
+  }
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+  {
+    if (palette)
+    {
+      setPixelColor(n, Color(r, g, b, w));
+      return;
+    }
+    changeThrough(n);
+    forgetLevel(n);
+    Adafruit_NeoPixel::setPixelColor(physical(n), r, g, b, w);
+    countLevel(n);
+  }
+  void setPixelColor(uint16_t n, uint32_t c)
+  {
+    changeThrough(n);
+    forgetLevel(n);
+    if (!palette)
+      Adafruit_NeoPixel::setPixelColor(physical(n), c);
+    else if (n < numLEDs)
+      pixels[physical(n)] = paletteIndex(c);
+    countLevel(n);
+  }
+  uint32_t getPixelColor(uint16_t n) const
+  {
+    if (!palette)
+      return Adafruit_NeoPixel::getPixelColor(physical(n));
+    if (n >= numLEDs)
+      return 0;
+    return paletteColor(pixels[physical(n)]);
+  }
+
+  void clear(void)
+  {
+    changedEnd = numLEDs;
+    powerLevels = 0;
+    Adafruit_NeoPixel::clear();
+  }
+
+  // Stores one color in a run of pixels, or from the first one to the end
+  // of the strand if count is 0, the same as the original fill().  The
+  // original stores straight into the buffer, so show() would not know
+  // those pixels had changed.
+  //
+  void fill(uint32_t color = 0, uint16_t first = 0, uint16_t count = 0)
+  {
+    if (first >= numLEDs)
+      return;
+    uint16_t end = (count && count < numLEDs - first)? first + count : numLEDs;
+    for (uint16_t n = first; n < end; n++)
+      setPixelColor(n, color);
+  }
+
+  void setBrightness(uint8_t b)
+  {
+    Adafruit_NeoPixel::setBrightness(b);
+    markChanged();
+  }
+
+  // If you change the bytes from getPixels() directly, call this so the
+  // next show() will know that the pixels may have changed.  With a power
+  // budget, this also counts up the pixels' levels again.
+  //
+  void markChanged()
+  {
+    changedEnd = numLEDs;
+    recountPower();
+  }
+
+  // Sends the pixel buffer to the strand.
+  //
+  // The pixels hold their colors until they get new data, so there is no
+  // need to send a frame which is the same as the last one.  If nothing
+  // has been stored since the last show(), we skip sending right away.
+  // If something has been stored, we compare a quick checksum of all the
+  // pixels against the frame we last sent, because a scroll of a strand
+  // filled with one color gives the same frame again.  A skipped frame
+  // saves about 30us per pixel, all of it with interrupts disabled.
+  //
+  // In partial show mode, show() works like showPrefix() below.
+  //
+  void show(void)
+  {
+    sendFrame(partial? changedEnd : numLEDs);
+  }
+
+  // Like show(), but only sends pixels up to the farthest one that has
+  // been stored since the last show.  Each pixel passes along the data
+  // meant for the pixels after it, so the first pixels can be updated by
+  // themselves, and the rest keep showing the colors they had.  Animating
+  // only a small accessory at the start of a long strand is then much
+  // faster.  Note that a scroll changes every pixel on the strand.
+  //
+  void showPrefix(void)
+  {
+    sendFrame(changedEnd);
+  }
+
+  void setPartialShow(bool enable) { partial = enable; }
+  bool isPartialShow() const { return partial; }
+
+  // Count the frames that show() actually sent, the ones it skipped
+  // because nothing changed, and how many of the sent frames were only a
+  // prefix of the strand.
+  //
+  unsigned long getShownFrames() const { return shownFrames; }
+  unsigned long getSkippedFrames() const { return skippedFrames; }
+  unsigned long getPartialFrames() const { return partialFrames; }
+  void resetFrameCounts() { shownFrames = skippedFrames = partialFrames = 0; }
+
+  // How long the last show() spent sending data to the strand, in
+  // microseconds:  10us per byte at 800KHz, 20us per byte at 400KHz.
+  //
+  unsigned long getShowMicros() const { return showMicros; }
+
+  // On AVR, interrupts are disabled while sending, and the millis() and
+  // micros() clocks can only catch up one timer overflow (1024us) when
+  // they are enabled again.  This estimates how much time those clocks
+  // have missed because of that, since the last reset.
+  //
+  unsigned long getStalledMicros() const { return stalledMicros; }
+  void resetStalledMicros() { stalledMicros = 0; }
+
+  // WS2812 pixels look much brighter at low levels than the numbers say,
+  // so a linear fade seems to do most of its dimming near the very end.
+  // With gamma correction, each byte is looked up in a table on its way
+  // out to the strand, so equal steps in the pixel buffer look like equal
+  // steps in brightness.  The buffer itself keeps the linear colors, so
+  // Bright(), getPixelColor() and the effects work the same either way.
+  //
+  void setGamma(bool enable)
+  {
+    gamma = enable;
+    markChanged();
+  }
+  bool isGamma() const { return gamma; }
+
+  static uint8_t Gamma(uint8_t value)
+  {
+    return pgm_read_byte(&NeoGammaTable[value]);
+  }
+
+  // Each channel of a WS2812 pixel draws about 20mA when fully on, so a
+  // long strand can easily ask for more current than a USB charger or a
+  // battery pack can supply, and then the pixels jitter or the Arduino
+  // browns out.  With a power budget in milliamps, the strand keeps a
+  // running total of every channel level in the buffer, adjusted as each
+  // pixel is stored or scrolled away, so show() can estimate the current
+  // without another pass over the pixels.  If the frame would draw more
+  // than the budget, every byte is scaled down on its way out to the
+  // strand by just enough to fit, the same way gamma correction works, and
+  // the buffer keeps the colors as stored.  The estimate allows about 1mA
+  // per pixel even when dark; with gamma correction, it errs on the high
+  // side.  A budget of 0 turns the limit off.
+  //
+  void setPowerBudget(uint16_t milliamps, uint8_t channelMilliamps = 20)
+  {
+    powerBudget = milliamps;
+    powerChannel = channelMilliamps;
+    markChanged();
+  }
+  uint16_t getPowerBudget() const { return powerBudget; }
+
+  // The current the colors now stored would draw without any limit, in
+  // milliamps, while a power budget is set.
+  //
+  uint32_t getPowerMilliamps() const
+  {
+    return numLEDs + powerLevels * powerChannel / 255;
+  }
+
+  // How far the last frame sent was scaled to fit the budget (0~255, the
+  // same as Bright()); 255 means it was not limited.
+  //
+  uint8_t getPowerLimit() const { return powerLimit; }
+
   static uint8_t White(uint32_t color) { return (color>>24) & 0xFF; }
   static uint8_t Red(uint32_t color) { return (color>>16) & 0xFF; }
   static uint8_t Green(uint32_t color) { return (color>>8) & 0xFF; }
@@ -53,6 +330,53 @@ public:
     return NeoStrand::Color(r, g, b, w);
   }
 
+  // Mix two colors (accepts values 0~255):  0 gives the first color, 255
+  // gives the second, and the values in between move each channel that
+  // far from the first color towards the second.  Mixing a color with
+  // itself always gives the same color back.
+  //
+  static uint32_t Blend(uint32_t from, uint32_t to, uint8_t amount)
+  {
+    uint16_t weight = amount + (amount >> 7);
+    return Color(mixByte(Red(from), Red(to), weight),
+                 mixByte(Green(from), Green(to), weight),
+                 mixByte(Blue(from), Blue(to), weight),
+                 mixByte(White(from), White(to), weight));
+  }
+
+  // Scale the brightness of a run of pixels already on the strand (accepts
+  // values 0~255), like calling Bright() on each of them, but working
+  // directly on the bytes in the pixel buffer.  Each byte is scaled with
+  // one 8-bit multiply, and no colors are unpacked or packed again.  Does
+  // not display immediately; follow up with a strand.show() call.
+  //
+  void scaleRange(uint16_t first, uint16_t count, uint8_t scale)
+  {
+    if (first >= numPixels() || scale == 255)
+      return;
+    if (count > numPixels() - first)
+      count = numPixels() - first;
+    if (palette)
+    {
+      // Indexed pixels have no bytes to scale; find the dimmer colors.
+      for (uint16_t i = first; i < first + count; i++)
+        setPixelColor(i, Bright(getPixelColor(i), scale));
+      return;
+    }
+    uint8_t stride = bytesPerPixel();
+    uint16_t start = physical(first);
+    uint16_t run = numPixels() - start;
+    if (run > count)
+      run = count;
+    if (powerBudget)
+      powerLevels -= sumLevels(first, count);
+    scaleBytes(pixels + start*stride, run*stride, scale);
+    scaleBytes(pixels, (count-run)*stride, scale);
+    if (powerBudget)
+      powerLevels += sumLevels(first, count);
+    changeThrough(first + count - 1);
+  }
+
   // Compute a bright color based on a given hue (color wheel position) 0~255.
   //
   static uint32_t Wheel(uint8_t WheelPos)
@@ -69,22 +393,57 @@ public:
     return Color(WheelPos * 3, 255 - WheelPos * 3, 0);
   }
 
+  // Compute a color from a hue, saturation and value.  The hue goes once
+  // around the color wheel over the whole 16-bit range (0~65535), so
+  // rainbows can step by much less than Wheel() allows:  red at 0, green
+  // at 21845, blue at 43690.  The wheel is cut into six sectors, and in
+  // each one a channel is either off, on, rising or falling; a small table
+  // gives the job of each channel, so there are no branches per sector.
+  //
+  static uint32_t ColorHSV(uint16_t hue, uint8_t sat = 255, uint8_t val = 255)
+  {
+    uint32_t wheel = hue * 6UL;
+    uint8_t jobs = pgm_read_byte(&NeoHSVSectors[wheel >> 16]);
+    uint8_t ramp = wheel >> 8;
+    uint8_t level[4] = { 0, ramp, (uint8_t)~ramp, 255 };
+    if (sat != 255 || val != 255)
+      for (uint8_t i = 0; i < 4; i++)
+        level[i] = scaleByte(~scaleByte(~level[i], sat), val);
+    return Color(level[jobs >> 4], level[(jobs >> 2) & 3], level[jobs & 3]);
+  }
+
+  // Fill a run of pixels with a rainbow.  The first pixel gets the given
+  // hue, and each pixel after it moves on by step (65536 is one full turn
+  // of the wheel, see ColorHSV()).  Does not display immediately; follow
+  // up with a strand.show() call.
+  //
+  void fillRainbow(uint16_t first, uint16_t count, uint16_t hue,
+                   uint16_t step, uint8_t sat = 255, uint8_t val = 255)
+  {
+    if (first >= numPixels())
+      return;
+    if (count > numPixels() - first)
+      count = numPixels() - first;
+    for (; count--; first++, hue += step)
+      setPixelColor(first, ColorHSV(hue, sat, val));
+  }
+
+  // The hue step which takes a rainbow once around the wheel in a given
+  // number of pixels.
+  //
+  static uint16_t RainbowStep(uint16_t count)
+  {
+    return count? (uint16_t)(65536UL / count) : 0;
+  }
+
   // Instantly or slowly wipes a constant color from the first to the last
   // pixel.  Displays immediately; no strand.show() call is required.
   //
   void wipeWithColor(uint32_t color, uint16_t wait = 0)
   {
-    for (uint16_t i = 0; i < numPixels(); i++)
-    {
-      setPixelColor(i, color);
-      if (wait)
-      {
-        show();
-        delay(wait);
-      }
-    }
-    if (!wait)
-      show();
+    startWipeWithColor(color, wait);
+    while (!stepWipe())
+      ;
   }
 
   // Instantly or slowly wipes a rainbow from the first to the last pixel.
@@ -95,18 +454,53 @@ public:
   //
   void wipeWithRainbow(uint8_t shift = 0, uint16_t wait = 0)
   {
-    for (uint16_t i = 0; i < numPixels(); i++)
+    startWipeWithRainbow(shift, wait);
+    while (!stepWipe())
+      ;
+  }
+
+  // The same wipes can be done a step at a time, so the sketch can keep
+  // reading buttons and doing other work during a slow wipe.  Start the
+  // wipe, then call stepWipe() once in every loop().  Each step does
+  // nothing until the wait time is up, then wipes the next pixel and
+  // displays it.  Returns true once the wipe is done, or if there is no
+  // wipe in progress.
+  //
+  void startWipeWithColor(uint32_t color, uint16_t wait = 0)
+  {
+    wipeColor = color;
+    wipeRainbow = false;
+    startWipe(wait);
+  }
+
+  void startWipeWithRainbow(uint8_t shift = 0, uint16_t wait = 0)
+  {
+    wipeHue = shift << 8;
+    wipeStep = RainbowStep(numPixels());
+    wipeRainbow = true;
+    startWipe(wait);
+  }
+
+  bool stepWipe(void)
+  {
+    if ((long)(millis() - wipeWake) < 0)
+      return false;
+    if (wipeNext >= numPixels())
+      return true;
+    do
     {
-      uint16_t hue = shift + (i * 256 / numPixels());
-      setPixelColor(i, Wheel(hue & 0xFF));
-      if (wait)
+      uint32_t color = wipeColor;
+      if (wipeRainbow)
       {
-        show();
-        delay(wait);
+        color = ColorHSV(wipeHue);
+        wipeHue += wipeStep;
       }
+      setPixelColor(wipeNext++, color);
     }
-    if (!wait)
-      show();
+    while (!wipeWait && wipeNext < numPixels());
+    show();
+    wipeWake = millis() + wipeWait;
+    return !wipeWait;
   }
 
   // Shifts all pixel color contents forward (away from pixel 0) by a given
@@ -123,11 +517,81 @@ public:
     amount = amount % numPixels();
     if (!amount)
       return;
+    changedEnd = numLEDs;
+    if (ring)
+    {
+      head = (head < amount)? head + numPixels() - amount : head - amount;
+      while (amount--)
+        setPixelColor(amount, color);
+      return;
+    }
+    scrollLevels(0, numPixels() - amount, amount);
     memmove(pixels+stride*amount, pixels, (numPixels()-amount)*stride);
     while (amount--)
       setPixelColor(amount, color);
   }
 
+  // Like scrollForward(), but the pixels that move along are also scaled
+  // in brightness (accepts values 0~255, the same as Bright()), so each
+  // color fed in at the start leaves a fading trail behind it like a
+  // comet.  The pixels are moved and scaled in the same pass over the
+  // buffer, so a trail costs about the same as a plain scroll.  Indexed
+  // pixels are scrolled as they are, and the palette entries are scaled
+  // instead, which fades every pixel at once.  Does not display
+  // immediately; follow up with a strand.show() call.
+  //
+  void scrollForwardFading(uint16_t amount, uint8_t scale, uint32_t color = 0)
+  {
+    if (scale == 255)
+    {
+      scrollForward(amount, color);
+      return;
+    }
+    if (!numPixels())
+      return;
+    if (palette)
+    {
+      // Move the indexes without storing the new color yet, since its
+      // entry must not be faded along with the rest.
+      amount = amount % numPixels();
+      changedEnd = numLEDs;
+      if (ring)
+        head = (head < amount)? head + numPixels() - amount : head - amount;
+      else
+        memmove(pixels + amount, pixels, numPixels() - amount);
+      fadePalette(scale);
+      recountPower();
+      while (amount--)
+        setPixelColor(amount, color);
+      return;
+    }
+    uint16_t stride = bytesPerPixel();
+    amount = amount % numPixels();
+    changedEnd = numLEDs;
+    uint32_t levels = 0;
+    if (ring)
+    {
+      // Only the head moves, so scale the whole buffer where it is.
+      head = (head < amount)? head + numPixels() - amount : head - amount;
+      levels = scaleBytes(pixels, numBytes, scale);
+    }
+    else
+    {
+      // Work back from the end, so each byte is read before the byte
+      // moving onto it is written.  The pixels left at the start keep
+      // their old colors until the new color is stored over them.
+      uint8_t* to = pixels + numBytes;
+      const uint8_t* from = to - amount*stride;
+      while (from > pixels)
+        levels += (*--to = scaleByte(*--from, scale));
+      if (powerBudget)
+        levels += sumLevels(0, amount);
+    }
+    powerLevels = powerBudget? levels : 0;
+    while (amount--)
+      setPixelColor(amount, color);
+  }
+
   // Shifts all pixel color contents backward (toward pixel 0) by a given
   // number of pixels. If given a color, the farthest pixel(s) are loaded
   // with that color; black is the default. If not given a number of
@@ -142,37 +606,1657 @@ public:
     amount = amount % numPixels();
     if (!amount)
       return;
+    changedEnd = numLEDs;
+    if (ring)
+    {
+      head += amount;
+      if (head >= numPixels())
+        head -= numPixels();
+      while (amount--)
+        setPixelColor(numPixels()-amount-1, color);
+      return;
+    }
+    scrollLevels(numPixels() - amount, 0, amount);
     memmove(pixels, pixels+stride*amount, (numPixels()-amount)*stride);
     while (amount--)
       setPixelColor(numPixels()-amount-1, color);
   }
 
+  // Like scrollForward() and scrollBackward(), but only the run of count
+  // pixels starting at pixel first moves; the pixels before and after the
+  // run stay where they are.  This is how a NeoSegment scrolls.  Does not
+  // display immediately; follow up with a strand.show() call.
+  //
+  void scrollRangeForward(uint16_t first, uint16_t count,
+                          uint16_t amount = 1, uint32_t color = 0)
+  {
+    if (first >= numPixels())
+      return;
+    if (count > numPixels() - first)
+      count = numPixels() - first;
+    if (!count)
+      return;
+    amount = amount % count;
+    if (!amount)
+      return;
+    scrollLevels(first, first + count - amount, amount);
+    moveRange(first + amount, first, count - amount);
+    changeThrough(first + count - 1);
+    while (amount--)
+      setPixelColor(first + amount, color);
+  }
+
+  void scrollRangeBackward(uint16_t first, uint16_t count,
+                           uint16_t amount = 1, uint32_t color = 0)
+  {
+    if (first >= numPixels())
+      return;
+    if (count > numPixels() - first)
+      count = numPixels() - first;
+    if (!count)
+      return;
+    amount = amount % count;
+    if (!amount)
+      return;
+    scrollLevels(first + count - amount, first, amount);
+    moveRange(first, first + amount, count - amount);
+    changeThrough(first + count - 1);
+    while (amount--)
+      setPixelColor(first + count - amount - 1, color);
+  }
+
 protected:
   bool isRGB() const { return (wOffset == rOffset); }
   bool isRGBW() const { return (wOffset != rOffset); }
-  uint8_t bytesPerPixel() const { return isRGBW()? 4 : 3; }
+  uint8_t bytesPerColor() const { return isRGBW()? 4 : 3; }
+  uint8_t bytesPerPixel() const { return palette? 1 : bytesPerColor(); }
 
-};
+  // Find where a pixel number is stored in the (possibly rotated) buffer.
+  // Out of range pixel numbers are passed through, so the original code
+  // still ignores them.
+  //
+  uint16_t physical(uint16_t n) const
+  {
+    if (n >= numLEDs)
+      return n;
+    n += head;
+    if (n >= numLEDs)
+      n -= numLEDs;
+    return n;
+  }
 
-//
-// Comments on the original Adafruit_NeoPixel code, which maybe Adafruit
-// will read and incorporate in future versions.
-//
-// 1. The number of times the original code uses (wOffset == rOffset) to
-//    figure out the channel storage scheme is excessive. Since there is
-//    no function name, it's not immediately obvious to the reader what
-//    the purpose might be, but it's pervasive in the code. Definitely
-//    wrap those in an inline member function isRGB() and isRGBW() as
-//    shown above to make the code more clear and maintainable.
-//
-// 2. A class that does dynamic allocation (operator new or malloc())
-//    should use a virtual destructor, so that extension classes will get
-//    the right behavior when code uses polymorphic calls.  This change
-//    costs one pointer per instance of the class.  Of course, using
-//    malloc() on a tiny microcontroller is already a little bit risky as
-//    memory can fragment over multiple construct/destruct cycles and you
-//    end up with a heap crash, but the likelihood that users will change
-//    strand length during a run is pretty rare.
+  // Clock out some bytes of the pixel buffer by temporarily pointing the
+  // original show() at them.  The original show() waits for the strand to
+  // latch before it starts, so a resumed transmission pretends the latch
+  // time has already passed.  It then follows the previous bytes after
+  // only a few microseconds, well short of the 50us low time which makes
+  // WS2812 pixels latch.
+  //
+  // An indexed strand passes its pixels through the palette on the way out
+  // instead, gamma correction passes each byte through the gamma table,
+  // and the power limit scales each byte; see transmitPixels().
+  //
+  void transmit(uint8_t* data, uint16_t bytes, bool resume)
+  {
+    if (palette)
+      transmitPixels(data, bytes, resume);
+    else if (gamma || powerLimit != 255)
+      transmitPixels(data, bytes / bytesPerColor(), resume);
+    else
+      transmitBytes(data, bytes, resume);
+  }
+
+  void transmitBytes(uint8_t* data, uint16_t bytes, bool resume)
+  {
+    uint8_t* saved = pixels;
+    uint16_t savedBytes = numBytes;
+    if (resume)
+      endTime = micros() - 1000;
+    pixels = data;
+    numBytes = bytes;
+    Adafruit_NeoPixel::show();
+    countSent(bytes);
+    pixels = saved;
+    numBytes = savedBytes;
+  }
+
+  void countSent(uint16_t bytes)
+  {
+#ifdef NEO_KHZ400
+    unsigned long sent = is800KHz? bytes * 10UL : bytes * 20UL;
+#else
+    unsigned long sent = bytes * 10UL;
+#endif
+    showMicros += sent;
+#ifdef __AVR__
+    if (sent > 1024)
+      stalledMicros += sent - 1024;
+#endif
+  }
+
+#if defined(__AVR__) && (F_CPU >= 15400000UL) && (F_CPU <= 19000000UL)
+  #define NEOSTRAND_EMITTER
+
+  // Clock out a few bytes at 800KHz on a 16MHz AVR, with the same 20-cycle
+  // bit timing as the original library:  high for 5 cycles for a 0 bit,
+  // or 13 cycles for a 1 bit.  Interrupts must already be disabled.  The
+  // line is left low after the last bit, and a new call can follow within
+  // a couple of microseconds, which the pixels accept as part of the same
+  // frame.
+  //
+  static void emitBytes(volatile uint8_t* port, uint8_t hi, uint8_t lo,
+                        const uint8_t* ptr, uint8_t count)
+  {
+    uint8_t next = lo;
+    uint8_t bit = 8;
+    uint8_t byte = *ptr++;
+    asm volatile(
+     "head_%=:"                   "\n\t" // Clk  Pseudocode    (T =  0)
+      "st   %a[port],  %[hi]"     "\n\t" // 2    PORT = hi     (T =  2)
+      "sbrc %[byte],  7"          "\n\t" // 1-2  if(b & 128)
+       "mov  %[next], %[hi]"      "\n\t" // 0-1   next = hi    (T =  4)
+      "dec  %[bit]"               "\n\t" // 1    bit--         (T =  5)
+      "st   %a[port],  %[next]"   "\n\t" // 2    PORT = next   (T =  7)
+      "mov  %[next] ,  %[lo]"     "\n\t" // 1    next = lo     (T =  8)
+      "breq nextbyte_%="          "\n\t" // 1-2  if(bit == 0)  (from dec above)
+      "rol  %[byte]"              "\n\t" // 1    b <<= 1       (T = 10)
+      "rjmp .+0"                  "\n\t" // 2    nop nop       (T = 12)
+      "nop"                       "\n\t" // 1    nop           (T = 13)
+      "st   %a[port],  %[lo]"     "\n\t" // 2    PORT = lo     (T = 15)
+      "nop"                       "\n\t" // 1    nop           (T = 16)
+      "rjmp .+0"                  "\n\t" // 2    nop nop       (T = 18)
+      "rjmp head_%="              "\n\t" // 2    -> head (next bit out)
+     "nextbyte_%=:"               "\n\t" //                    (T = 10)
+      "ldi  %[bit]  ,  8"         "\n\t" // 1    bit = 8       (T = 11)
+      "ld   %[byte] ,  %a[ptr]+"  "\n\t" // 2    b = *ptr++    (T = 13)
+      "st   %a[port], %[lo]"      "\n\t" // 2    PORT = lo     (T = 15)
+      "nop"                       "\n\t" // 1    nop           (T = 16)
+      "dec  %[count]"             "\n\t" // 1    count--       (T = 17)
+      "nop"                       "\n\t" // 1    nop           (T = 18)
+      "brne head_%="              "\n"    // 2    if(count) -> head
+      : [port]  "+e" (port),
+        [byte]  "+r" (byte),
+        [bit]   "+r" (bit),
+        [next]  "+r" (next),
+        [count] "+r" (count),
+        [ptr]   "+e" (ptr)
+      : [hi]    "r" (hi),
+        [lo]    "r" (lo));
+  }
+
+  // Clock out a run of pixels, as they should be sent (see outputPixel()).
+  // Interrupts must already be disabled.  Pixels which can go straight
+  // from the buffer are sent as runs of bytes, and the others a pixel at
+  // a time.
+  //
+  void emitPixels(const uint8_t* data, uint16_t count, uint8_t hi, uint8_t lo)
+  {
+    uint8_t size = bytesPerColor();
+    if (!palette && !gamma && powerLimit == 255)
+    {
+      for (uint16_t bytes = count * size; bytes; )
+      {
+        uint8_t run = (bytes < 240)? bytes : 240;
+        emitBytes(port, hi, lo, data, run);
+        data += run;
+        bytes -= run;
+      }
+      return;
+    }
+    uint8_t pixel[4];
+    for (uint16_t i = 0; i < count; i++)
+      emitBytes(port, hi, lo, outputPixel(data, i, pixel), size);
+  }
+#endif
+
+  // Send some pixels which can't go straight from the pixel buffer:
+  // palette indexes are sent as the colors they stand for, with gamma
+  // correction, each byte is sent as its entry in the gamma table, and
+  // over the power budget, each byte is scaled down.  On a
+  // 16MHz AVR strand at 800KHz, each pixel is worked out and clocked out
+  // in turn with interrupts disabled for the whole run, so no converted
+  // copy of the frame is ever needed.  Elsewhere, a few pixels at a time
+  // are converted into a small buffer, and each one follows the last as a
+  // resumed transmission (see transmit()).
+  //
+  void transmitPixels(const uint8_t* data, uint16_t count, bool resume)
+  {
+    uint8_t size = bytesPerColor();
+#ifdef NEOSTRAND_EMITTER
+  #ifdef NEO_KHZ400
+    if (is800KHz)
+  #endif
+    {
+      if (!count)
+        return;
+      while (!resume && !canShow())
+        ;
+      uint8_t hi = *port | pinMask;
+      uint8_t lo = *port & ~pinMask;
+      noInterrupts();
+      emitPixels(data, count, hi, lo);
+      interrupts();
+      endTime = micros();
+      countSent(count * size);
+      return;
+    }
+#endif
+    uint8_t pixel[4];
+    uint8_t chunk[16 * 4];
+    while (count)
+    {
+      uint8_t run = (count < 16)? count : 16;
+      uint8_t* p = chunk;
+      for (uint8_t i = 0; i < run; i++, p += size)
+        memcpy(p, outputPixel(data, i, pixel), size);
+      transmitBytes(chunk, run * size, resume);
+      resume = true;
+      data += palette? run : run * size;
+      count -= run;
+    }
+  }
+
+  // Find the bytes to send for pixel i of the data.  Gamma correction
+  // and the power limit need somewhere to put the changed bytes, so they
+  // use the given pixel.  The limit is applied after the gamma table, so
+  // the current drawn scales with it.
+  //
+  const uint8_t* outputPixel(const uint8_t* data, uint16_t i,
+                             uint8_t* pixel) const
+  {
+    uint8_t size = bytesPerColor();
+    const uint8_t* p = palette? palette->colors + data[i] * size :
+                                data + i * size;
+    if (!gamma && powerLimit == 255)
+      return p;
+    for (uint8_t c = 0; c < size; c++)
+      pixel[c] = scaleByte(gamma? Gamma(p[c]) : p[c], powerLimit);
+    return pixel;
+  }
+
+  // Find a palette entry for a color, adding it to the palette if it is
+  // new.  When the palette fills up, the entries no pixel still uses are
+  // reclaimed, which means a pass over the whole strand; if every entry
+  // is really in use, the nearest color is used instead.  Colors tend to
+  // be stored many times in a row, so the last match is remembered.
+  //
+  uint8_t paletteIndex(uint32_t color)
+  {
+    if (color == palette->lastColor)
+      return palette->lastIndex;
+    uint8_t size = bytesPerColor();
+    uint8_t entry[4];
+    entry[rOffset] = Red(color);
+    entry[gOffset] = Green(color);
+    entry[bOffset] = Blue(color);
+    if (size == 4)
+      entry[wOffset] = White(color);
+    int16_t found = -1;
+    for (uint16_t i = 0; i < palette->size; i++)
+    {
+      if (!isMarked(i))
+      {
+        if (found < 0)
+          found = i;
+        continue;
+      }
+      if (!memcmp(palette->colors + i * size, entry, size))
+        return rememberIndex(color, i);
+    }
+    if (found < 0)
+      found = reclaimPalette();
+    if (found < 0)
+      return rememberIndex(color, nearestIndex(entry));
+    memcpy(palette->colors + found * size, entry, size);
+    palette->marks[found >> 3] |= 1 << (found & 7);
+    return rememberIndex(color, found);
+  }
+
+  uint8_t rememberIndex(uint32_t color, uint8_t index)
+  {
+    palette->lastColor = color;
+    palette->lastIndex = index;
+    return index;
+  }
+
+  bool isMarked(uint8_t index) const
+  {
+    return palette->marks[index >> 3] & (1 << (index & 7));
+  }
+
+  // Mark only the entries found in the pixel buffer, plus black and the
+  // last match, and return the first free entry, if any.  The frame
+  // checksum includes the epoch, since an entry might now get a new color
+  // while a pixel from the last frame sent still refers to it.
+  //
+  int16_t reclaimPalette()
+  {
+    memset(palette->marks, 0, (palette->size + 7) / 8);
+    palette->marks[0] = 1;
+    palette->marks[palette->lastIndex >> 3] |= 1 << (palette->lastIndex & 7);
+    for (uint16_t i = 0; i < numLEDs; i++)
+      palette->marks[pixels[i] >> 3] |= 1 << (pixels[i] & 7);
+    palette->epoch++;
+    for (uint16_t i = 0; i < palette->size; i++)
+      if (!isMarked(i))
+        return i;
+    return -1;
+  }
+
+  uint8_t nearestIndex(const uint8_t* entry) const
+  {
+    uint8_t size = bytesPerColor();
+    uint8_t best = 0;
+    uint16_t bestDistance = 0xFFFF;
+    for (uint16_t i = 0; i < palette->size; i++)
+    {
+      const uint8_t* p = palette->colors + i * size;
+      uint16_t distance = 0;
+      for (uint8_t c = 0; c < size; c++)
+        distance += (p[c] > entry[c])? p[c] - entry[c] : entry[c] - p[c];
+      if (distance < bestDistance)
+      {
+        best = i;
+        bestDistance = distance;
+      }
+    }
+    return best;
+  }
+
+  // Scale every palette entry, so every pixel using it fades.  The last
+  // match fades along with its entry, and the epoch tells the checksum
+  // that the same indexes may now show different colors.
+  //
+  void fadePalette(uint8_t scale)
+  {
+    scaleBytes(palette->colors, palette->size * bytesPerColor(), scale);
+    palette->lastColor = paletteColor(palette->lastIndex);
+    palette->epoch++;
+  }
+
+  uint32_t paletteColor(uint8_t index) const
+  {
+    const uint8_t* p = palette->colors + index * bytesPerColor();
+    uint8_t w = isRGBW()? p[wOffset] : 0;
+    return Color(p[rOffset], p[gOffset], p[bOffset], w);
+  }
+
+  // The sum of the channel levels of the pixel stored at a place in the
+  // buffer, and of a run of pixels, for the power budget.
+  //
+  uint16_t levelAt(uint16_t place) const
+  {
+    uint8_t size = bytesPerColor();
+    const uint8_t* p = palette? palette->colors + pixels[place] * size :
+                                pixels + place * size;
+    uint16_t level = 0;
+    for (uint8_t c = 0; c < size; c++)
+      level += p[c];
+    return level;
+  }
+
+  uint32_t sumLevels(uint16_t first, uint16_t count) const
+  {
+    uint32_t sum = 0;
+    for (; count--; first++)
+      sum += levelAt(physical(first));
+    return sum;
+  }
+
+  void recountPower()
+  {
+    powerLevels = powerBudget? sumLevels(0, numLEDs) : 0;
+  }
+
+  // Keep the running total up to date around a store to pixel n.
+  //
+  void forgetLevel(uint16_t n)
+  {
+    if (powerBudget && n < numLEDs)
+      powerLevels -= levelAt(physical(n));
+  }
+
+  void countLevel(uint16_t n)
+  {
+    if (powerBudget && n < numLEDs)
+      powerLevels += levelAt(physical(n));
+  }
+
+  // Keep the running total up to date when a scroll moves the bytes:  the
+  // amount pixels from gone are pushed off the end of the run, and the
+  // amount pixels from stale are left with their old colors, which are
+  // taken off again as the new colors are stored over them.  A scroll
+  // which only moves the head of a ring needs none of this, since the
+  // pixels pushed off the end are the ones stored over.
+  //
+  void scrollLevels(uint16_t stale, uint16_t gone, uint16_t amount)
+  {
+    if (!powerBudget)
+      return;
+    powerLevels += sumLevels(stale, amount);
+    powerLevels -= sumLevels(gone, amount);
+  }
+
+  // How far to scale the frame to keep it within the power budget.  A
+  // byte scaled by s comes out as value*(s+1)/256 (see scaleByte()), so
+  // s is worked out from that, or the frame would draw a little too much.
+  //
+  uint8_t powerScale() const
+  {
+    if (!powerBudget)
+      return 255;
+    if (powerBudget <= numLEDs)
+      return 0;
+    uint32_t allowed = powerBudget - numLEDs;
+    uint32_t drive = powerLevels * powerChannel;
+    if (drive / 255 <= allowed)
+      return 255;
+    uint32_t fit = allowed * 65280UL / drive;
+    return fit? fit - 1 : 0;
+  }
+
+  // Move a run of pixels to another place on the strand, like memmove()
+  // so the two places may overlap.  In ring buffer mode, either run may
+  // wrap around the end of the buffer, so the move is done in up to three
+  // pieces which don't wrap, starting from the end which is safe to
+  // overwrite first.
+  //
+  void moveRange(uint16_t to, uint16_t from, uint16_t count)
+  {
+    uint8_t stride = bytesPerPixel();
+    while (count)
+    {
+      uint16_t a, b, run;
+      if (to > from)
+      {
+        a = physical(to + count - 1);
+        b = physical(from + count - 1);
+        run = (a < b)? a + 1 : b + 1;
+        if (run > count)
+          run = count;
+        a -= run - 1;
+        b -= run - 1;
+      }
+      else
+      {
+        a = physical(to);
+        b = physical(from);
+        run = numLEDs - ((a > b)? a : b);
+        if (run > count)
+          run = count;
+        to += run;
+        from += run;
+      }
+      memmove(pixels + a*stride, pixels + b*stride, run*stride);
+      count -= run;
+    }
+  }
+
+  // Put a rotated buffer back in order, with pixel 0 first.  This is done
+  // in place by reversing both parts of the buffer, then the whole thing.
+  //
+  void unrotate()
+  {
+    if (!head)
+      return;
+    uint16_t split = head * bytesPerPixel();
+    reverseBytes(pixels, pixels + split);
+    reverseBytes(pixels + split, pixels + numBytes);
+    reverseBytes(pixels, pixels + numBytes);
+    head = 0;
+  }
+
+  // Scale each byte by (scale+1)/256, the same factor Bright() uses.  The
+  // sum is written out so the compiler can use a single 8x8 multiply.
+  //
+  static uint8_t scaleByte(uint8_t value, uint8_t scale)
+  {
+    return ((uint16_t)value * scale + value) >> 8;
+  }
+
+  // Move a byte part of the way towards another, by weight/256.
+  //
+  static uint8_t mixByte(uint8_t from, uint8_t to, uint16_t weight)
+  {
+    if (to >= from)
+      return from + (((uint16_t)(to - from) * weight) >> 8);
+    return from - (((uint16_t)(from - to) * weight) >> 8);
+  }
+
+  // Scale a run of bytes, and give back the sum of the scaled bytes, so a
+  // fade can count the power levels along the way.
+  //
+  static uint32_t scaleBytes(uint8_t* p, uint16_t bytes, uint8_t scale)
+  {
+    uint32_t sum = 0;
+    while (bytes--)
+    {
+      *p = scaleByte(*p, scale);
+      sum += *p++;
+    }
+    return sum;
+  }
+
+  void startWipe(uint16_t wait)
+  {
+    wipeNext = 0;
+    wipeWait = wait;
+    wipeWake = millis();
+  }
+
+  // Remember the farthest pixel changed since the last show.
+  //
+  void changeThrough(uint16_t n)
+  {
+    if (n >= changedEnd && n < numLEDs)
+      changedEnd = n + 1;
+  }
+
+  // Send the first few pixels of the frame, if the frame has changed.
+  //
+  void sendFrame(uint16_t count)
+  {
+    showMicros = 0;
+    if (changedEnd)
+    {
+      changedEnd = 0;
+      // A new limit scales every pixel, so send them all.
+      uint8_t limit = powerScale();
+      if (limit != powerLimit)
+        count = numLEDs;
+      powerLimit = limit;
+      uint32_t sum = checksum();
+      if (sum != lastSum || !shownFrames)
+      {
+        lastSum = sum;
+        shownFrames++;
+        if (count < numLEDs)
+          partialFrames++;
+        sendPrefix(count);
+        return;
+      }
+    }
+    skippedFrames++;
+  }
+
+  // Send the first few pixels, starting from the head of the buffer.  If
+  // they wrap around the end of a rotated buffer, the strand must still
+  // see one continuous stream of pixels in the right order.  On a 16MHz
+  // AVR strand at 800KHz, the part from the head to the end of the buffer
+  // and the part at the start of the buffer are clocked out in one run,
+  // with interrupts disabled for both.  Elsewhere, the original show()
+  // can only send one run of bytes, so the buffer is put back in order
+  // first, which takes much less time than sending it.
+  //
+  void sendPrefix(uint16_t count)
+  {
+    uint8_t stride = bytesPerPixel();
+    uint16_t split = head * stride;
+    uint16_t bytes = count * stride;
+    if (bytes <= numBytes - split)
+    {
+      transmit(pixels + split, bytes, false);
+      return;
+    }
+#ifdef NEOSTRAND_EMITTER
+  #ifdef NEO_KHZ400
+    if (is800KHz)
+  #endif
+    {
+      while (!canShow())
+        ;
+      uint8_t hi = *port | pinMask;
+      uint8_t lo = *port & ~pinMask;
+      noInterrupts();
+      emitPixels(pixels + split, numLEDs - head, hi, lo);
+      emitPixels(pixels, count - (numLEDs - head), hi, lo);
+      interrupts();
+      endTime = micros();
+      countSent(count * bytesPerColor());
+      return;
+    }
+#endif
+    unrotate();
+    transmit(pixels, bytes, false);
+  }
+
+  // A Fletcher-style checksum of all the pixel bytes, in pixel order.  The
+  // second sum makes it sensitive to the order, so a frame with the same
+  // colors in different places won't be mistaken for the last frame.  The
+  // gamma setting and the power limit start off the second sum, so
+  // changing either one sends the same pixels again.
+  //
+  uint32_t checksum() const
+  {
+    uint16_t split = head * bytesPerPixel();
+    uint16_t a = 0;
+    uint16_t b = gamma | (powerLimit << 1);
+    if (palette)
+    {
+      a = palette->epoch;
+      sumIndexes(pixels + split, pixels + numBytes, a, b);
+      sumIndexes(pixels, pixels + split, a, b);
+    }
+    else
+    {
+      sumBytes(pixels + split, pixels + numBytes, a, b);
+      sumBytes(pixels, pixels + split, a, b);
+    }
+    return ((uint32_t)b << 16) | a;
+  }
+
+  static void sumBytes(const uint8_t* p, const uint8_t* end,
+                       uint16_t& a, uint16_t& b)
+  {
+    for (; p < end; p++)
+    {
+      a += *p;
+      b += a;
+    }
+  }
+
+  // Palette indexes are small numbers, and sums of small numbers often
+  // come out the same after a scroll (5+5+5 is 7+1+7), so each index is
+  // first scrambled over all 16 bits.
+  //
+  static void sumIndexes(const uint8_t* p, const uint8_t* end,
+                         uint16_t& a, uint16_t& b)
+  {
+    for (; p < end; p++)
+    {
+      uint16_t x = (*p + 1) * 40503U;
+      a += x ^ (x >> 7);
+      b += a;
+    }
+  }
+
+  static void reverseBytes(uint8_t* first, uint8_t* last)
+  {
+    while (first < last)
+    {
+      uint8_t swap = *first;
+      *first++ = *--last;
+      *last = swap;
+    }
+  }
+
+protected:
+  uint16_t head;
+  bool ring;
+  bool partial;
+  uint16_t changedEnd;
+  NeoPalette* palette;
+  bool gamma;
+  uint16_t powerBudget;
+  uint8_t powerChannel;
+  uint8_t powerLimit;
+  uint32_t powerLevels;
+  uint32_t lastSum;
+  unsigned long shownFrames;
+  unsigned long skippedFrames;
+  unsigned long partialFrames;
+  unsigned long showMicros;
+  unsigned long stalledMicros;
+  uint16_t wipeNext;
+  uint16_t wipeWait;
+  unsigned long wipeWake;
+  uint32_t wipeColor;
+  uint16_t wipeHue;
+  uint16_t wipeStep;
+  bool wipeRainbow;
+
+private:
+  // The original rainbow() stores straight into the buffer, so show()
+  // would not know the pixels had changed.  Use fillRainbow() instead.
+  void rainbow(uint16_t, int8_t = 1, uint8_t = 255, uint8_t = 255,
+               bool = true);
+
+  // The original updateLength() and updateType() allocate a new buffer,
+  // which would leave the ring's head, the change tracking and the power
+  // levels describing the old one.  Construct a new strand instead.
+  void updateLength(uint16_t);
+  void updateType(neoPixelType);
+
+};
+
+//----------------------------------------------------------------------------
+
+// A segment is a view of a run of pixels on a strand, such as a ring or
+// one of two ponytails which share the strand's data line.  It has no
+// pixels of its own, and passes everything on to the strand.  Its pixels
+// are numbered from 0, either in the same direction as the strand, or
+// reversed for a run which is mounted the other way around.  Each segment
+// can be filled, wiped, scrolled and dimmed without disturbing the rest
+// of the strand.
+//
+// The segment is made for the strand's own class, so a NeoStrandT stores
+// the segment's pixels with its faster setPixelColor().
+//
+//   NeoStrand strand(160, 6);
+//   NeoSegment<> ring(strand, 0, 16);
+//   NeoSegment<> tail(strand, 16, 144, true);
+//
+//   NeoStrandT<160, 6> fixed;
+//   NeoSegment<NeoStrandT<160, 6> > fixedRing(fixed, 0, 16);
+//
+template <class STRAND = NeoStrand>
+class NeoSegment
+{
+public:
+  NeoSegment(STRAND& s, uint16_t f, uint16_t n, bool r = false) :
+    strand(s), first(f), length(n), reversed(r),
+    wipeNext(0xFFFF), wipeWait(0), wipeWake(0), wipeColor(0) { ; }
+
+  STRAND& getStrand() const { return strand; }
+  uint16_t getFirst() const { return first; }
+  uint16_t numPixels() const { return length; }
+  bool isReversed() const { return reversed; }
+
+  void setPixelColor(uint16_t n, uint32_t c)
+  {
+    if (n < length)
+      strand.setPixelColor(place(n), c);
+  }
+  uint32_t getPixelColor(uint16_t n) const
+  {
+    return (n < length)? strand.getPixelColor(place(n)) : 0;
+  }
+
+  // Sets every pixel of the segment to one color (black by default).
+  // Does not display immediately; follow up with a strand.show() call.
+  //
+  void fill(uint32_t color = 0)
+  {
+    for (uint16_t i = 0; i < length; i++)
+      strand.setPixelColor(first + i, color);
+  }
+
+  // Same as NeoStrand::fillRainbow(), counting from the start of the
+  // segment.
+  //
+  void fillRainbow(uint16_t hue, uint16_t step,
+                   uint8_t sat = 255, uint8_t val = 255)
+  {
+    for (uint16_t i = 0; i < length; i++, hue += step)
+      setPixelColor(i, NeoStrand::ColorHSV(hue, sat, val));
+  }
+
+  // Same as NeoStrand::scaleRange() over the whole segment.
+  //
+  void scale(uint8_t bright)
+  {
+    strand.scaleRange(first, length, bright);
+  }
+
+  // Same as NeoStrand::scrollForward() and scrollBackward(), but only the
+  // pixels of the segment move, in the segment's own direction.
+  //
+  void scrollForward(uint16_t amount = 1, uint32_t color = 0)
+  {
+    if (reversed)
+      strand.scrollRangeBackward(first, length, amount, color);
+    else
+      strand.scrollRangeForward(first, length, amount, color);
+  }
+
+  void scrollBackward(uint16_t amount = 1, uint32_t color = 0)
+  {
+    if (reversed)
+      strand.scrollRangeForward(first, length, amount, color);
+    else
+      strand.scrollRangeBackward(first, length, amount, color);
+  }
+
+  // Same as NeoStrand::wipeWithColor(), and the same wipe a step at a time,
+  // from the start to the end of the segment.  Each step displays the
+  // whole strand.
+  //
+  void wipeWithColor(uint32_t color, uint16_t wait = 0)
+  {
+    startWipeWithColor(color, wait);
+    while (!stepWipe())
+      ;
+  }
+
+  void startWipeWithColor(uint32_t color, uint16_t wait = 0)
+  {
+    wipeColor = color;
+    wipeNext = 0;
+    wipeWait = wait;
+    wipeWake = millis();
+  }
+
+  bool stepWipe(void)
+  {
+    if ((long)(millis() - wipeWake) < 0)
+      return false;
+    if (wipeNext >= length)
+      return true;
+    do
+      setPixelColor(wipeNext++, wipeColor);
+    while (!wipeWait && wipeNext < length);
+    strand.show();
+    wipeWake = millis() + wipeWait;
+    return !wipeWait;
+  }
+
+private:
+  uint16_t place(uint16_t n) const
+  {
+    return first + (reversed? length - 1 - n : n);
+  }
+
+  STRAND& strand;
+  uint16_t first;
+  uint16_t length;
+  bool reversed;
+  uint16_t wipeNext;
+  uint16_t wipeWait;
+  unsigned long wipeWake;
+  uint32_t wipeColor;
+};
+
+//----------------------------------------------------------------------------
+
+// Feeds colors in at the top of a strand or segment which scrolls forward
+// by whole pixels, as a ScrollClock gives them (see Generic.h), and shows
+// how far the scroll is into the next pixel.  Each step takes in the color
+// of that moment, and between steps, the top two pixels share the light of
+// what came in:  the newest color fades in at pixel 0 while the color of
+// the last step moves from pixel 0 to pixel 1, and the one before it fades
+// out of pixel 1.  A color which came in for only one step then moves
+// smoothly from pixel 0 to pixel 1, with the same light all the way,
+// instead of jumping by a whole pixel.  Past pixel 1, it moves by whole
+// pixels, as the strand scrolls.
+//
+// Call settle() just before each scroll, so the top two pixels move on
+// with their whole colors, then feed() with the color of every frame.
+//
+//   NeoFeed<NeoSegment<> > feed(ring);
+//   ...
+//   unsigned int steps = scrollClock.advance(now);
+//   if (steps) { feed.settle(); strand.scrollForward(steps); }
+//   feed.feed(steps, scrollClock.fraction(), color);
+//
+template <class SEGMENT = NeoSegment<> >
+class NeoFeed
+{
+public:
+  NeoFeed(SEGMENT& s) : segment(s), top(0), next(0) { ; }
+
+  void settle()
+  {
+    segment.setPixelColor(0, top);
+    segment.setPixelColor(1, next);
+  }
+
+  void feed(unsigned int steps, uint8_t fraction, uint32_t color)
+  {
+    if (steps)
+    {
+      next = (steps > 1)? color : top;
+      top = color;
+      for (unsigned int i = 2; i < steps; i++)
+        segment.setPixelColor(i, color);
+    }
+    segment.setPixelColor(0, NeoStrand::Blend(top, color, fraction));
+    segment.setPixelColor(1, NeoStrand::Blend(next, top, fraction));
+  }
+
+private:
+  SEGMENT& segment;
+  uint32_t top;
+  uint32_t next;
+};
+
+//----------------------------------------------------------------------------
+
+// A NeoStrand whose length, pin and pixel type are all decided when the
+// sketch is compiled.  The pixel buffer is an array inside the object, so
+// a global strand is allocated along with the other global variables and
+// never touches malloc().  Since the channel offsets and the bytes per
+// pixel are constants, the compiler can reduce setPixelColor(), scrolling
+// and wiping down to a few direct loads and stores with no checks of the
+// pixel type.
+//
+//   NeoStrandT<144, 6> strand;
+//   NeoStrandT<60, 6, NEO_GRBW + NEO_KHZ800> strand;
+//
+// The faster functions only replace NeoStrand's by name, since none of
+// them are virtual, so this kind of strand can't be passed around as a
+// NeoStrand or an Adafruit_NeoPixel:  the calls would go to the general
+// versions, or to updateLength() and updateType(), which would try to
+// free() or resize the fixed buffer.  The rest of NeoStrand's functions
+// are offered as they are.  Those which store pixels themselves, such as
+// the slow wipes, scaleRange() and the range scrolls, give the same
+// results here, but through the general setPixelColor(), which checks
+// the pixel type at run time.  Use NeoSegment<NeoStrandT<...> > for a
+// segment, so its pixels are stored the fast way.
+//
+template <uint16_t LENGTH, uint8_t PIN, neoPixelType TYPE = NEO_GRB + NEO_KHZ800>
+class NeoStrandT : protected NeoStrand
+{
+public:
+  using NeoStrand::begin;
+  using NeoStrand::numPixels;
+  using NeoStrand::getPixels;
+  using NeoStrand::getBrightness;
+  using NeoStrand::canShow;
+  using NeoStrand::setRingBuffer;
+  using NeoStrand::isRingBuffer;
+  using NeoStrand::clear;
+  using NeoStrand::fill;
+  using NeoStrand::setBrightness;
+  using NeoStrand::markChanged;
+  using NeoStrand::show;
+  using NeoStrand::showPrefix;
+  using NeoStrand::setPartialShow;
+  using NeoStrand::isPartialShow;
+  using NeoStrand::getShownFrames;
+  using NeoStrand::getSkippedFrames;
+  using NeoStrand::getPartialFrames;
+  using NeoStrand::resetFrameCounts;
+  using NeoStrand::getShowMicros;
+  using NeoStrand::getStalledMicros;
+  using NeoStrand::resetStalledMicros;
+  using NeoStrand::setGamma;
+  using NeoStrand::isGamma;
+  using NeoStrand::setPowerBudget;
+  using NeoStrand::getPowerBudget;
+  using NeoStrand::getPowerMilliamps;
+  using NeoStrand::getPowerLimit;
+  using NeoStrand::scaleRange;
+  using NeoStrand::startWipeWithColor;
+  using NeoStrand::startWipeWithRainbow;
+  using NeoStrand::stepWipe;
+  using NeoStrand::scrollRangeForward;
+  using NeoStrand::scrollRangeBackward;
+  using NeoStrand::Color;
+  using NeoStrand::White;
+  using NeoStrand::Red;
+  using NeoStrand::Green;
+  using NeoStrand::Blue;
+  using NeoStrand::Bright;
+  using NeoStrand::Blend;
+  using NeoStrand::Gamma;
+  using NeoStrand::Wheel;
+  using NeoStrand::ColorHSV;
+  using NeoStrand::RainbowStep;
+  enum
+  {
+    W_OFFSET = (TYPE >> 6) & 3,
+    R_OFFSET = (TYPE >> 4) & 3,
+    G_OFFSET = (TYPE >> 2) & 3,
+    B_OFFSET = TYPE & 3,
+    STRIDE = (W_OFFSET == R_OFFSET)? 3 : 4,
+    BYTES = LENGTH * STRIDE,
+  };
+
+  NeoStrandT(void) :
+    NeoStrand()
+  {
+    // The pixel buffer is still NULL here, so updateType() won't try to
+    // allocate one.
+    Adafruit_NeoPixel::updateType(TYPE);
+    setPin(PIN);
+    memset(storage, 0, sizeof(storage));
+    pixels = storage;
+    numLEDs = LENGTH;
+    numBytes = BYTES;
+    changedEnd = LENGTH;
+  }
+
+  // The original destructor would try to free() our buffer.
+  ~NeoStrandT() { pixels = NULL; }
+
+public:
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b)
+  {
+    setPixelColor(n, r, g, b, 0);
+  }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+  {
+    if (n >= LENGTH)
+      return;
+    if (n >= changedEnd)
+      changedEnd = n + 1;
+    if (brightness)
+    {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+      w = (w * brightness) >> 8;
+    }
+    uint8_t* p = storage + place(n) * STRIDE;
+    if (powerBudget)
+      powerLevels -= level(p);
+    p[R_OFFSET] = r;
+    p[G_OFFSET] = g;
+    p[B_OFFSET] = b;
+    if (STRIDE == 4)
+      p[W_OFFSET] = w;
+    if (powerBudget)
+      powerLevels += level(p);
+  }
+
+  void setPixelColor(uint16_t n, uint32_t c)
+  {
+    setPixelColor(n, Red(c), Green(c), Blue(c), White(c));
+  }
+
+  uint32_t getPixelColor(uint16_t n) const
+  {
+    if (n >= LENGTH)
+      return 0;
+    const uint8_t* p = storage + place(n) * STRIDE;
+    uint8_t w = (STRIDE == 4)? p[W_OFFSET] : 0;
+    if (!brightness)
+      return Color(p[R_OFFSET], p[G_OFFSET], p[B_OFFSET], w);
+    return Color((p[R_OFFSET] << 8) / brightness,
+                 (p[G_OFFSET] << 8) / brightness,
+                 (p[B_OFFSET] << 8) / brightness,
+                 (w << 8) / brightness);
+  }
+
+  // Same as NeoStrand::wipeWithColor().  An instant wipe stores the same
+  // bytes in every pixel, so we work out those bytes only once.
+  //
+  void wipeWithColor(uint32_t color, uint16_t wait = 0)
+  {
+    if (wait)
+    {
+      NeoStrand::wipeWithColor(color, wait);
+      return;
+    }
+    setPixelColor(0, color);
+    const uint8_t* first = storage + place(0) * STRIDE;
+    uint8_t pixel[STRIDE];
+    memcpy(pixel, first, STRIDE);
+    for (uint8_t* p = storage; p < storage + BYTES; p += STRIDE)
+      memcpy(p, pixel, STRIDE);
+    if (powerBudget)
+      powerLevels = (uint32_t)level(pixel) * LENGTH;
+    changedEnd = LENGTH;
+    show();
+  }
+
+  // Same as NeoStrand::wipeWithRainbow().
+  //
+  void wipeWithRainbow(uint8_t shift = 0, uint16_t wait = 0)
+  {
+    if (wait)
+    {
+      NeoStrand::wipeWithRainbow(shift, wait);
+      return;
+    }
+    fillRainbow(0, LENGTH, shift << 8, RainbowStep(LENGTH));
+    show();
+  }
+
+  // Same as NeoStrand::fillRainbow().
+  //
+  void fillRainbow(uint16_t first, uint16_t count, uint16_t hue,
+                   uint16_t step, uint8_t sat = 255, uint8_t val = 255)
+  {
+    if (first >= LENGTH)
+      return;
+    if (count > LENGTH - first)
+      count = LENGTH - first;
+    for (; count--; first++, hue += step)
+      setPixelColor(first, ColorHSV(hue, sat, val));
+  }
+
+  // Same as NeoStrand::scrollForward().
+  //
+  void scrollForward(uint16_t amount = 1, uint32_t color = 0)
+  {
+    amount = amount % LENGTH;
+    if (!amount)
+      return;
+    changedEnd = LENGTH;
+    if (ring)
+      head = (head < amount)? head + LENGTH - amount : head - amount;
+    else
+    {
+      scrollLevels(0, LENGTH - amount, amount);
+      memmove(storage+STRIDE*amount, storage, (LENGTH-amount)*STRIDE);
+    }
+    while (amount--)
+      setPixelColor(amount, color);
+  }
+
+  // Same as NeoStrand::scrollForwardFading().
+  //
+  void scrollForwardFading(uint16_t amount, uint8_t scale, uint32_t color = 0)
+  {
+    if (scale == 255)
+    {
+      scrollForward(amount, color);
+      return;
+    }
+    amount = amount % LENGTH;
+    changedEnd = LENGTH;
+    uint32_t levels = 0;
+    if (ring)
+    {
+      head = (head < amount)? head + LENGTH - amount : head - amount;
+      levels = scaleBytes(storage, BYTES, scale);
+    }
+    else
+    {
+      uint8_t* to = storage + BYTES;
+      const uint8_t* from = to - amount*STRIDE;
+      while (from > storage)
+        levels += (*--to = scaleByte(*--from, scale));
+      if (powerBudget)
+        levels += sumLevels(0, amount);
+    }
+    powerLevels = powerBudget? levels : 0;
+    while (amount--)
+      setPixelColor(amount, color);
+  }
+
+  // Same as NeoStrand::scrollBackward().
+  //
+  void scrollBackward(uint16_t amount = 1, uint32_t color = 0)
+  {
+    amount = amount % LENGTH;
+    if (!amount)
+      return;
+    changedEnd = LENGTH;
+    if (ring)
+    {
+      head += amount;
+      if (head >= LENGTH)
+        head -= LENGTH;
+    }
+    else
+    {
+      scrollLevels(LENGTH - amount, 0, amount);
+      memmove(storage, storage+STRIDE*amount, (LENGTH-amount)*STRIDE);
+    }
+    while (amount--)
+      setPixelColor(LENGTH-amount-1, color);
+  }
+
+protected:
+  // Like physical(), but for pixel numbers already known to be in range.
+  uint16_t place(uint16_t n) const
+  {
+    n += head;
+    return (n >= LENGTH)? n - LENGTH : n;
+  }
+
+  static uint16_t level(const uint8_t* p)
+  {
+    uint16_t sum = p[0] + p[1] + p[2];
+    return (STRIDE == 4)? sum + p[3] : sum;
+  }
+
+private:
+  uint8_t storage[BYTES];
+
+  // The buffer is fixed, and can't be copied.
+  NeoStrandT(const NeoStrandT&) = delete;
+  NeoStrandT& operator=(const NeoStrandT&) = delete;
+};
+
+//----------------------------------------------------------------------------
+
+// A NeoStrand which stores one byte per pixel:  an index into a palette
+// of 16 or 256 colors.  The palette is expanded to the strand's color
+// bytes on the fly while sending, so a strand can be about three times
+// as long in the same memory, and scrolling has a third of the bytes to
+// move.  The palette fills itself with the colors stored by
+// setPixelColor(), and entries are reused once no pixel shows them any
+// longer.  If more colors are on the strand at once than the palette
+// can hold, new colors are shown as the nearest color already there.
+//
+//   NeoStrandIndexed<600, 6> strand;
+//   NeoStrandIndexed<500, 6, NEO_GRB + NEO_KHZ800, 256> strand;
+//
+// Entry 0 is always black, so clear() works as usual.  getPixels()
+// returns the indexes.  The brightness can't be set on this kind of
+// strand, since the original setBrightness() would scale the indexes as
+// if they were colors; store dimmer colors, or use scaleRange(), instead.
+// For the same reason, and because the buffer is fixed, this kind of
+// strand can't be passed around as a NeoStrand or an Adafruit_NeoPixel.
+// Use NeoSegment<NeoStrandIndexed<...> > for a segment.
+//
+template <uint16_t LENGTH, uint8_t PIN,
+          neoPixelType TYPE = NEO_GRB + NEO_KHZ800, uint16_t COLORS = 16>
+class NeoStrandIndexed : protected NeoStrand
+{
+public:
+  using NeoStrand::begin;
+  using NeoStrand::numPixels;
+  using NeoStrand::getPixels;
+  using NeoStrand::canShow;
+  using NeoStrand::setRingBuffer;
+  using NeoStrand::isRingBuffer;
+  using NeoStrand::setPixelColor;
+  using NeoStrand::getPixelColor;
+  using NeoStrand::clear;
+  using NeoStrand::fill;
+  using NeoStrand::markChanged;
+  using NeoStrand::show;
+  using NeoStrand::showPrefix;
+  using NeoStrand::setPartialShow;
+  using NeoStrand::isPartialShow;
+  using NeoStrand::getShownFrames;
+  using NeoStrand::getSkippedFrames;
+  using NeoStrand::getPartialFrames;
+  using NeoStrand::resetFrameCounts;
+  using NeoStrand::getShowMicros;
+  using NeoStrand::getStalledMicros;
+  using NeoStrand::resetStalledMicros;
+  using NeoStrand::setGamma;
+  using NeoStrand::isGamma;
+  using NeoStrand::setPowerBudget;
+  using NeoStrand::getPowerBudget;
+  using NeoStrand::getPowerMilliamps;
+  using NeoStrand::getPowerLimit;
+  using NeoStrand::scaleRange;
+  using NeoStrand::fillRainbow;
+  using NeoStrand::wipeWithColor;
+  using NeoStrand::wipeWithRainbow;
+  using NeoStrand::startWipeWithColor;
+  using NeoStrand::startWipeWithRainbow;
+  using NeoStrand::stepWipe;
+  using NeoStrand::scrollForward;
+  using NeoStrand::scrollForwardFading;
+  using NeoStrand::scrollBackward;
+  using NeoStrand::scrollRangeForward;
+  using NeoStrand::scrollRangeBackward;
+  using NeoStrand::Color;
+  using NeoStrand::White;
+  using NeoStrand::Red;
+  using NeoStrand::Green;
+  using NeoStrand::Blue;
+  using NeoStrand::Bright;
+  using NeoStrand::Blend;
+  using NeoStrand::Gamma;
+  using NeoStrand::Wheel;
+  using NeoStrand::ColorHSV;
+  using NeoStrand::RainbowStep;
+
+  enum
+  {
+    STRIDE = (((TYPE >> 6) & 3) == ((TYPE >> 4) & 3))? 3 : 4,
+  };
+
+  NeoStrandIndexed(void) :
+    NeoStrand()
+  {
+    static_assert(COLORS >= 2 && COLORS <= 256, "palette must fit a byte");
+    Adafruit_NeoPixel::updateType(TYPE);
+    setPin(PIN);
+    memset(storage, 0, sizeof(storage));
+    memset(colors, 0, sizeof(colors));
+    memset(marks, 0, sizeof(marks));
+    marks[0] = 1;
+    table.colors = colors;
+    table.marks = marks;
+    table.size = COLORS;
+    table.epoch = 0;
+    table.lastIndex = 0;
+    table.lastColor = 0;
+    palette = &table;
+    pixels = storage;
+    numLEDs = LENGTH;
+    numBytes = LENGTH;
+    changedEnd = LENGTH;
+  }
+
+  // The original destructor would try to free() our buffer.
+  ~NeoStrandIndexed() { pixels = NULL; }
+
+  // How many palette entries may be in use, including black.
+  //
+  uint16_t getPaletteUsed() const
+  {
+    uint16_t used = 0;
+    for (uint16_t i = 0; i < COLORS; i++)
+      if (isMarked(i))
+        used++;
+    return used;
+  }
+
+private:
+  uint8_t storage[LENGTH];
+  uint8_t colors[COLORS * STRIDE];
+  uint8_t marks[(COLORS + 7) / 8];
+  NeoPalette table;
+
+  // The buffer is fixed, and can't be copied.
+  NeoStrandIndexed(const NeoStrandIndexed&) = delete;
+  NeoStrandIndexed& operator=(const NeoStrandIndexed&) = delete;
+};
+
+//----------------------------------------------------------------------------
+
+// Several strands, each on its own pin, sent all at the same time.  A
+// strand takes 30us per pixel to send, so two long ponytails and a ring
+// on one pin take about 9ms per frame.  With each on its own lane, the
+// frame only takes as long as the longest lane.
+//
+// The lanes are on consecutive pins of one port, starting from FIRST_PIN:
+// pins 2~7 (port D) or 8~13 (port B) on an Uno, Nano or Pro Mini.  Every
+// lane has room for LENGTH pixels; a shorter strand on a lane just
+// ignores the data for the pixels it doesn't have.
+//
+//   NeoLanes<3, 144, 2> lanes;   // pins 2, 3 and 4
+//   lanes.setPixelColor(1, 0, color);
+//
+// The bytes of all the lanes are interleaved, so the same byte of every
+// lane is together in memory.  By default, the lanes are sent one after
+// the other, through the original library.  On a 16MHz AVR at 800KHz,
+// defining NEOLANES_EMITTER before including NeoStrand.h sends them
+// together instead:  each of the eight bits of those bytes is sent as one
+// write to the port, with each lane's bit in its own pin's place, so all
+// the lanes see their bits at the same time.  Its timing has not yet been
+// checked with a logic analyzer or a cycle-counting simulator, so it is
+// left off until it has.
+//
+//   #define NEOLANES_EMITTER
+//   #include "NeoStrand.h"
+//
+template <uint8_t LANES, uint16_t LENGTH, uint8_t FIRST_PIN,
+          neoPixelType TYPE = NEO_GRB + NEO_KHZ800>
+class NeoLanes
+{
+public:
+  enum
+  {
+    W_OFFSET = (TYPE >> 6) & 3,
+    R_OFFSET = (TYPE >> 4) & 3,
+    G_OFFSET = (TYPE >> 2) & 3,
+    B_OFFSET = TYPE & 3,
+    STRIDE = (W_OFFSET == R_OFFSET)? 3 : 4,
+    COLUMNS = LENGTH * STRIDE,
+    FIRST_BIT = (FIRST_PIN < 8)? FIRST_PIN : (FIRST_PIN < 14)?
+                FIRST_PIN - 8 : FIRST_PIN - 14,
+#ifdef NEO_KHZ400
+    KHZ800 = !(TYPE & NEO_KHZ400),
+#else
+    KHZ800 = 1,
+#endif
+  };
+
+  NeoLanes(void) : sender(), endTime(0), showMicros(0)
+  {
+    static_assert(LANES >= 1 && FIRST_BIT + LANES <= 8,
+                  "lanes must all be on one port");
+    memset(storage, 0, sizeof(storage));
+  }
+
+  void begin(void)
+  {
+    for (uint8_t lane = 0; lane < LANES; lane++)
+    {
+      pinMode(FIRST_PIN + lane, OUTPUT);
+      digitalWrite(FIRST_PIN + lane, LOW);
+    }
+  }
+
+  uint8_t numLanes() const { return LANES; }
+  uint16_t numPixels() const { return LENGTH; }
+
+  void setPixelColor(uint8_t lane, uint16_t n, uint32_t c)
+  {
+    if (lane >= LANES || n >= LENGTH)
+      return;
+    uint8_t* p = storage + n * STRIDE * LANES + lane;
+    p[R_OFFSET * LANES] = (uint8_t)(c >> 16);
+    p[G_OFFSET * LANES] = (uint8_t)(c >> 8);
+    p[B_OFFSET * LANES] = (uint8_t)c;
+    if (STRIDE == 4)
+      p[W_OFFSET * LANES] = (uint8_t)(c >> 24);
+  }
+  uint32_t getPixelColor(uint8_t lane, uint16_t n) const
+  {
+    if (lane >= LANES || n >= LENGTH)
+      return 0;
+    const uint8_t* p = storage + n * STRIDE * LANES + lane;
+    uint8_t w = (STRIDE == 4)? p[W_OFFSET * LANES] : 0;
+    return NeoStrand::Color(p[R_OFFSET * LANES], p[G_OFFSET * LANES],
+                            p[B_OFFSET * LANES], w);
+  }
+
+  // Sets every pixel of one lane, or of every lane, to one color (black
+  // by default).
+  //
+  void fill(uint8_t lane, uint32_t color = 0)
+  {
+    for (uint16_t n = 0; n < LENGTH; n++)
+      setPixelColor(lane, n, color);
+  }
+  void clear(void) { memset(storage, 0, sizeof(storage)); }
+
+  // The eight values written to the port for one byte column, most
+  // significant bit first, with lane n's bit in bit n.  See transposeBits()
+  // in Generic.h.
+  //
+  void getPlanes(uint16_t column, uint8_t* planes) const
+  {
+    uint8_t bytes[8] = { 0 };
+    if (column < COLUMNS)
+      memcpy(bytes, storage + column * LANES, LANES);
+    transposeBits(bytes, planes);
+  }
+
+  bool canShow(void) const { return (micros() - endTime) >= 300L; }
+
+  // How long the last show() spent sending data, in microseconds.
+  //
+  unsigned long getShowMicros() const { return showMicros; }
+
+  void show(void)
+  {
+    while (!canShow())
+      ;
+#if defined(NEOLANES_EMITTER) && defined(NEOSTRAND_EMITTER) && \
+    defined(GENERIC_FAST_PINS)
+    // The emitter's timing is only for 800KHz.
+    if (KHZ800)
+    {
+      volatile uint8_t* port = (FIRST_PIN < 8)? &PORTD :
+                               (FIRST_PIN < 14)? &PORTB : &PORTC;
+      uint8_t mask = ((1 << LANES) - 1) << FIRST_BIT;
+      uint8_t hi = *port | mask;
+      uint8_t lo = *port & ~mask;
+      const uint8_t* p = storage;
+      noInterrupts();
+      for (uint16_t i = 0; i < COLUMNS; i++, p += LANES)
+        emitColumn(port, hi, lo,
+                   laneByte<0>(p), laneByte<1>(p), laneByte<2>(p),
+                   laneByte<3>(p), laneByte<4>(p), laneByte<5>(p),
+                   laneByte<6>(p), laneByte<7>(p));
+      interrupts();
+      showMicros = COLUMNS * 16UL;
+      endTime = micros();
+      return;
+    }
+#endif
+    // Copy a few pixels of one lane at a time out of the interleaved
+    // bytes, and send them the same way as NeoStrand::transmitBytes().
+    // The lanes are on different pins, so only the first one has to wait
+    // for the strand to latch.
+    uint8_t chunk[16 * STRIDE];
+    bool resume = false;
+    showMicros = 0;
+    for (uint8_t lane = 0; lane < LANES; lane++)
+    {
+      sender.setPin(FIRST_PIN + lane);
+      for (uint16_t i = 0; i < COLUMNS; i += sizeof(chunk))
+      {
+        uint16_t run = COLUMNS - i;
+        if (run > sizeof(chunk))
+          run = sizeof(chunk);
+        for (uint16_t j = 0; j < run; j++)
+          chunk[j] = storage[(i + j) * LANES + lane];
+        sender.send(chunk, run, resume);
+        resume = true;
+      }
+      showMicros += COLUMNS * (KHZ800? 10UL : 20UL);
+    }
+    endTime = micros();
+  }
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b, uint8_t w = 0)
+  {
+    return NeoStrand::Color(r, g, b, w);
+  }
+
+private:
+#if defined(NEOLANES_EMITTER) && defined(NEOSTRAND_EMITTER) && \
+    defined(GENERIC_FAST_PINS)
+  // The byte for the pin on bit K of the port, or 0 if no lane uses it.
+  //
+  template <uint8_t K>
+  static uint8_t laneByte(const uint8_t* column)
+  {
+    return (K >= FIRST_BIT && K < FIRST_BIT + LANES)?
+      column[(uint8_t)(K - FIRST_BIT) % LANES] : 0;
+  }
+
+  // Clock out one byte of every lane together, given as the byte for each
+  // bit of the port.  Each bit goes out as three writes, like emitBytes()
+  // but with every lane's pin at once:  all high, then the bit-plane
+  // which lets the lanes sending a 0 go low after 6 cycles, then all low
+  // after 14 cycles.  The next bit-plane is worked out while this one is
+  // on the wire, by shifting the top bit out of each byte into place (the
+  // same transpose as transposeBits() in Generic.h), which takes 17 cycles
+  // and makes each bit 27 cycles (1.7us) long.  The high times are within
+  // a cycle of the original library's; only the low times are longer,
+  // which the pixels accept.  Interrupts must already be disabled.
+  //
+  // This timing has only been worked out by counting cycles, and the
+  // shifts checked against a C model on the host.  It has not yet been run
+  // on a real strand, so check it with a scope before relying on it.
+  //
+  static void emitColumn(volatile uint8_t* port, uint8_t hi, uint8_t lo,
+                         uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3,
+                         uint8_t b4, uint8_t b5, uint8_t b6, uint8_t b7)
+  {
+    uint8_t bit = 8;
+    uint8_t plane;
+    uint8_t next;
+    asm volatile(
+      "lsl  %[b7]"                "\n\t" // work out the first plane
+      "rol  %[next]"              "\n\t"
+      "lsl  %[b6]"                "\n\t"
+      "rol  %[next]"              "\n\t"
+      "lsl  %[b5]"                "\n\t"
+      "rol  %[next]"              "\n\t"
+      "lsl  %[b4]"                "\n\t"
+      "rol  %[next]"              "\n\t"
+      "lsl  %[b3]"                "\n\t"
+      "rol  %[next]"              "\n\t"
+      "lsl  %[b2]"                "\n\t"
+      "rol  %[next]"              "\n\t"
+      "lsl  %[b1]"                "\n\t"
+      "rol  %[next]"              "\n\t"
+      "lsl  %[b0]"                "\n\t"
+      "rol  %[next]"              "\n\t"
+      "or   %[next],  %[lo]"      "\n\t"
+      "mov  %[plane], %[next]"    "\n\t"
+     "head_%=:"                   "\n\t" // Clk  Pseudocode    (T =  0)
+      "st   %a[port], %[hi]"      "\n\t" // 2    PORT = hi     (T =  2)
+      "lsl  %[b7]"                "\n\t" // 1    next <<= 1,
+      "rol  %[next]"              "\n\t" // 1    next |= b7>>7 (T =  4)
+      "lsl  %[b6]"                "\n\t" // 1
+      "rol  %[next]"              "\n\t" // 1    (b6)          (T =  6)
+      "st   %a[port], %[plane]"   "\n\t" // 2    PORT = plane  (T =  8)
+      "lsl  %[b5]"                "\n\t" // 1
+      "rol  %[next]"              "\n\t" // 1    (b5)          (T = 10)
+      "lsl  %[b4]"                "\n\t" // 1
+      "rol  %[next]"              "\n\t" // 1    (b4)          (T = 12)
+      "lsl  %[b3]"                "\n\t" // 1
+      "rol  %[next]"              "\n\t" // 1    (b3)          (T = 14)
+      "st   %a[port], %[lo]"      "\n\t" // 2    PORT = lo     (T = 16)
+      "lsl  %[b2]"                "\n\t" // 1
+      "rol  %[next]"              "\n\t" // 1    (b2)          (T = 18)
+      "lsl  %[b1]"                "\n\t" // 1
+      "rol  %[next]"              "\n\t" // 1    (b1)          (T = 20)
+      "lsl  %[b0]"                "\n\t" // 1
+      "rol  %[next]"              "\n\t" // 1    (b0)          (T = 22)
+      "or   %[next],  %[lo]"      "\n\t" // 1    next |= lo    (T = 23)
+      "mov  %[plane], %[next]"    "\n\t" // 1    plane = next  (T = 24)
+      "dec  %[bit]"               "\n\t" // 1    bit--         (T = 25)
+      "brne head_%="              "\n"    // 2    if(bit) -> head
+      : [b0]    "+r" (b0),
+        [b1]    "+r" (b1),
+        [b2]    "+r" (b2),
+        [b3]    "+r" (b3),
+        [b4]    "+r" (b4),
+        [b5]    "+r" (b5),
+        [b6]    "+r" (b6),
+        [b7]    "+r" (b7),
+        [plane] "=&r" (plane),
+        [next]  "=&r" (next),
+        [bit]   "+r" (bit)
+      : [port]  "e" (port),
+        [hi]    "r" (hi),
+        [lo]    "r" (lo));
+  }
+#endif
+
+  // Sends bytes through the original show(), on whichever pin is set.
+  //
+  struct Sender : public Adafruit_NeoPixel
+  {
+    Sender() : Adafruit_NeoPixel(0, FIRST_PIN, TYPE) { ; }
+
+    void send(uint8_t* data, uint16_t bytes, bool resume)
+    {
+      uint8_t* saved = pixels;
+      uint16_t savedBytes = numBytes;
+      if (resume)
+        endTime = micros() - 1000;
+      pixels = data;
+      numBytes = bytes;
+      Adafruit_NeoPixel::show();
+      pixels = saved;
+      numBytes = savedBytes;
+    }
+  };
+
+  uint8_t storage[COLUMNS * LANES];
+  Sender sender;
+  unsigned long endTime;
+  unsigned long showMicros;
+
+  NeoLanes(const NeoLanes&) = delete;
+  NeoLanes& operator=(const NeoLanes&) = delete;
+};
+
+//
+// Comments on the original Adafruit_NeoPixel code, which maybe Adafruit
+// will read and incorporate in future versions.
+//
+// 1. The number of times the original code uses (wOffset == rOffset) to
+//    figure out the channel storage scheme is excessive. Since there is
+//    no function name, it's not immediately obvious to the reader what
+//    the purpose might be, but it's pervasive in the code. Definitely
+//    wrap those in an inline member function isRGB() and isRGBW() as
+//    shown above to make the code more clear and maintainable.
+//
+// 2. A class that does dynamic allocation (operator new or malloc())
+//    should use a virtual destructor, so that extension classes will get
+//    the right behavior when code uses polymorphic calls.  This change
+//    costs one pointer per instance of the class.  Of course, using
+//    malloc() on a tiny microcontroller is already a little bit risky as
+//    memory can fragment over multiple construct/destruct cycles and you
+//    end up with a heap crash, but the likelihood that users will change
+//    strand length during a run is pretty rare.
+//
+// 3. The show(), setPixelColor() and getPixelColor() functions are not
+//    virtual.  NeoStrand provides its own versions to support the ring
+//    buffer mode, but code which only sees an Adafruit_NeoPixel pointer
+//    or reference will call the originals, and bypass the rotation.
 //
 
 //-------------------------------------------------------------------------------------
@@ -72,12 +72,48 @@
 // STRAND_PIN and the NeoPixel strand input.  Suggested resistor value is
 // 470ohms.
 //
+// The strand's pixel buffer is sized when the sketch is compiled, so the
+// Arduino IDE includes it in the global variable memory it reports.  Keep
+// an eye on that number when making the strand longer.
+//
+// At 3 bytes per pixel, an Arduino Uno runs out of memory at around 400
+// pixels.  Set STRAND_PALETTE to 16 or 256 to store a single byte per
+// pixel instead, which picks a color from a palette of that many colors.
+// The effects only use a few colors at a time, but the fades and the
+// dimmer make many shades of each, so 256 colors look better.
+//
+// The effects and the dimmer work with linear brightness levels, which
+// make fades seem to hold bright and then drop off at the end.  Set
+// STRAND_GAMMA to 1 to correct each byte on its way out to the strand,
+// so fades look even.  Everything also looks dimmer, so you may want a
+// higher RESTING_BRIGHTNESS with it.
+//
 #include "NeoStrand.h"
 #define STRAND_PIN 11
 #define ACCESSORY_LENGTH 16
 #define CHARACTER_LENGTH 144
 #define STRAND_LENGTH (ACCESSORY_LENGTH+CHARACTER_LENGTH)
-NeoStrand strand = NeoStrand(STRAND_LENGTH, STRAND_PIN);
+#define STRAND_PALETTE 0
+#define STRAND_GAMMA 0
+#if STRAND_PALETTE
+typedef NeoStrandIndexed<STRAND_LENGTH, STRAND_PIN, NEO_GRB + NEO_KHZ800,
+                         STRAND_PALETTE> Strand;
+#else
+typedef NeoStrandT<STRAND_LENGTH, STRAND_PIN> Strand;
+#endif
+Strand strand;
+
+// The accessory and the character each get a segment of the strand, so
+// each can be scrolled and filled by itself (see NeoStrand.h).
+//
+NeoSegment<Strand> accessory(strand, 0, ACCESSORY_LENGTH);
+NeoSegment<Strand> character(strand, ACCESSORY_LENGTH, CHARACTER_LENGTH);
+
+// Each segment's colors are fed in at its top, blended across its top two
+// pixels as the scroll moves into the next pixel (see NeoStrand.h).
+//
+NeoFeed<NeoSegment<Strand> > accessoryFeed(accessory);
+NeoFeed<NeoSegment<Strand> > characterFeed(character);
 
 // We connect three normally-open momentary buttons (with helpfully
 // colored caps) to three data pins on the Arduino.  The opposite pin of
@@ -92,6 +128,7 @@ NeoStrand strand = NeoStrand(STRAND_LENGTH, STRAND_PIN);
 #define LUKA_BUTTON 9
 #define TWIN_BUTTON 8
 #define MIKU_BUTTON 7
+ButtonBank<LUKA_BUTTON, TWIN_BUTTON, MIKU_BUTTON> buttons;
 
 // If a special debugging button is wired up, we can react to it.  This can
 // be useful on the breadboard stage, but left out of the final circuit
@@ -99,24 +136,51 @@ NeoStrand strand = NeoStrand(STRAND_LENGTH, STRAND_PIN);
 //
 #define DEBUG_BUTTON 4
 
+// The buttons are watched by pin change interrupts, so each press or
+// release is noticed the moment it happens, even while the main loop() is
+// busy.  The interrupt handler reads all the buttons together and queues
+// the new input vector along with the time, for the main loop() to pick up
+// in its next frame.  If the queue ever overflows, the main loop() reads
+// the buttons again itself.
+//
+struct ButtonEvent
+{
+  unsigned long millis;
+  uint8_t vector;
+};
+EventQueue<ButtonEvent, 16> buttonEvents;
+volatile bool buttonOverflow = false;
+
 // These are timing constants that we use to control the speed of various
-// parts of the sketch.  Each loop cycle is roughly 1~3ms, depending on the
-// length of the strand.
+// parts of the sketch.  The main loop runs at a steady FRAME_RATE (frames
+// per second), so each loop cycle takes the same time no matter how much
+// work it has to do.  Each frame has to leave enough time to send the
+// whole strand, about 30us per pixel, plus about a millisecond for
+// everything else.  Use a lower rate for longer strands.
 //
-#define SCROLL_CYCLES 2
+// The waterfall scrolls at SCROLL_SPEED pixels per second, going by the
+// time that has passed rather than counting frames, so it moves at the
+// same speed on any length of strand and at any frame rate.
+//
+#define FRAME_RATE 160
+#define SCROLL_SPEED 80
 #define RAINBOW_CYCLES 2
-#define CONFIRMATION_CYCLES 12
+#define CONFIRMATION_MILLIS 75
 #define HISTORY_CYCLES 250
 #define HOLD_MODE_CYCLES 800
 
 // We want to keep some historical data on recent button pushes, to detect
 // special patterns of presses like hold, double-tap, etc.  In this way,
-// we can greatly increase the power of the limited user interface.
+// we can greatly increase the power of the limited user interface.  The
+// history is kept by a gesture recognizer, declared with the effects
+// below.  The time the buttons last changed is kept in inputMillis, for
+// accurate tap timing.  That is up to CONFIRMATION_MILLIS before the
+// change could be confirmed, so the time it was confirmed, when the user
+// first sees anything happen, is kept in confirmedMillis for the effects.
 //
 #define HISTORY_LENGTH 6
-unsigned long history_millis = 0;
-unsigned long history_time[HISTORY_LENGTH];
-int history_vector[HISTORY_LENGTH];
+unsigned long inputMillis = 0;
+unsigned long confirmedMillis = 0;
 
 // This list of names corresponds to all of the major Vocaloid modes that
 // we want to support.  Since we have three buttons, we have a maximum of
@@ -184,7 +248,42 @@ enum
   SPARKLING,  // double-tap the buttons quickly and stop
   SHUTDOWN,   // hold the buttons for 3 seconds
 };
+
+// The effects are chosen by gestures, each described by a table of the
+// button presses and releases it takes, most recent first (see Generic.h).
+// The first gesture that matches wins, so the longer ones come first.
+//
+const Gesture EffectGestures[] PROGMEM =
+{
+  // Tap the same buttons three times at a steady beat.
+  { PULSING, GESTURE_MS(HISTORY_CYCLES), 6,
+    { { NOBODY, 0, 0 }, { GESTURE_TAP, 0, 0 },
+      { NOBODY, 0, 0 }, { GESTURE_TAP, 0, 0 },
+      { NOBODY, 0, 0 }, { GESTURE_TAP, 0, 0 } } },
+
+  // Tap the same buttons twice, quickly.
+  { SPARKLING, 0, 4,
+    { { NOBODY, 0, 0 }, { GESTURE_TAP, 0, 0 },
+      { NOBODY, 0, GESTURE_MS(HISTORY_CYCLES*2) }, { GESTURE_TAP, 0, 0 } } },
+
+  // Hold any buttons down.
+  { SHUTDOWN, 0, 1,
+    { { GESTURE_TAP, GESTURE_MS(HOLD_MODE_CYCLES), 0 } } },
+};
+GestureRecognizer<HISTORY_LENGTH> gestures(EffectGestures);
+
+// The PULSING effect follows a beat phase, where one full turn of a 32-bit
+// counter is one beat.  Each frame, the phase advances by the elapsed
+// milliseconds times the step, and it wraps around to zero by itself at
+// the end of every beat.  The step is rounded from 2^32 divided by the
+// tapped period, so even after hours the phase is still well within a
+// millisecond of the tapped tempo.
+//
 unsigned long pulsingPeriod = 1000;
+unsigned long pulsingStep = 4294967UL;
+unsigned long pulsingPhase = 0;
+unsigned long pulsingMillis = 0;
+unsigned long pulsingOrigin = 0;
 
 // NeoPixel brightness ranges from 0~255.
 // Full brightness is energy-inefficient and blindingly bright.  We also
@@ -193,9 +292,64 @@ unsigned long pulsingPeriod = 1000;
 // between the DIMMER_PIN and VCC will let you further adjust the overall
 // effect.  Suggested value is 10kohm.
 //
+// The potentiometer is sampled in the background, and smoothed so that
+// the dimmer only changes when the knob is really turned.
+//
 #define RESTING_BRIGHTNESS 130
 #define DIMMER_PIN (A0)
 int dimmer = 255;
+AnalogFilter dimmerKnob;
+
+// The strand can also keep its own current draw under what the supply can
+// give, by scaling down any frame which would need more.  Then the flashes
+// can run brighter on a battery pack without the pixels jittering or the
+// Arduino browning out.  Set POWER_BUDGET to the milliamps the supply can
+// spare for the strand (say 1800 on a 2A USB port), or 0 for no limit.
+//
+#define POWER_BUDGET 0
+
+// The colors for the current mode are needed in every frame, but they only
+// change when the mode, the dimmer or the rainbow color changes.  So the
+// dimmed colors are worked out once, and kept until one of those changes.
+//
+struct ModeColors
+{
+  int mode;
+  int dimmer;
+  uint32_t base;       // VocaloidColors[mode]
+  uint32_t accent;     // AccessoryColors[mode]
+  uint32_t full;       // the base color, dimmed
+  uint32_t resting;    // the base color at RESTING_BRIGHTNESS, dimmed
+  uint32_t accessory;  // the accent color, dimmed
+};
+ModeColors cachedColors = { -1, -1, 0, 0, 0, 0, 0 };
+
+// The sparkles of the effects and the startup sequence come from a fast
+// random number generator (see Generic.h), seeded after the first button
+// push.
+//
+FastRandom32 sparkle;
+
+// The startup sequence and its parts are cooperative tasks (see Generic.h).
+// Each does one frame's worth of work per call, so the main loop() keeps
+// reading the buttons and the dimmer in every frame while they run.  The
+// mode chosen during startup is kept in startupTarget.
+//
+Task startup;
+Task waiting;
+Task booting;
+int startupTarget = MIKU;
+
+// The frame clock paces the main loop() at FRAME_RATE, and measures how
+// busy each frame is (see Generic.h).
+//
+static_assert(FRAME_RATE > 0, "FRAME_RATE must be at least 1");
+FrameClock frameClock = FrameClock(FRAME_RATE);
+
+// The scroll clock turns the time that passes into the waterfall motion
+// down the strand (see Generic.h).
+//
+ScrollClock scrollClock = ScrollClock(SCROLL_SPEED);
 
 //----------------------------------------------------------------------------
 
@@ -218,47 +372,89 @@ void setup()
   pinMode(MIKU_BUTTON, INPUT_PULLUP);
   pinMode(DEBUG_BUTTON, INPUT_PULLUP);
   //pinMode(DIMMER_PIN, INPUT);
+  dimmerKnob.begin(DIMMER_PIN - A0);
+  captureButtons();
+#ifdef PCICR
+  enableButtonInterrupt(LUKA_BUTTON);
+  enableButtonInterrupt(TWIN_BUTTON);
+  enableButtonInterrupt(MIKU_BUTTON);
+#endif
   
   // LEDs are output devices.
   // Set up the NeoStrand device which will initialize the pin mode and
-  // all of the pixels on the strand are cleared to black/off.
+  // all of the pixels on the strand are cleared to black/off.  The boot
+  // cascade and the waterfall scroll the whole strand very often, so we
+  // let the strand scroll by rotating its buffer instead of moving every
+  // pixel.  Between scrolls, only the first pixel of the accessory and of
+  // the character change, so we let the strand send just the pixels up to
+  // the last one that changed.
   //
+  strand.setRingBuffer(true);
+  strand.setPartialShow(true);
+  strand.setGamma(STRAND_GAMMA);
+  strand.setPowerBudget(POWER_BUDGET);
   strand.begin();
   strand.show();
+  scrollClock.start(frameClock.now());
 
   // When we first power on, we wait for user input before full effect.
+  // The main loop() carries out the startup sequence a step at a time.
   //
-  mode = performWait(MIKU);
-  mode = performBoot(mode);
+  startupTarget = MIKU;
+  startup.start();
 }
 
 //----------------------------------------------------------------------------
 
-int performWait(int target)
+// The startup sequence waits for the user to choose a mode, then plays the
+// boot cascade.  It runs again whenever the user holds buttons to shut
+// down.
+//
+bool performStartup(int vector)
+{
+  TASK_BEGIN(startup);
+
+  // Finish any wipe that was started before the sequence.
+  TASK_WAIT_UNTIL(startup, strand.stepWipe());
+
+  waiting.start();
+  TASK_WAIT_UNTIL(startup, performWait(vector));
+
+  booting.start();
+  TASK_WAIT_UNTIL(startup, performBoot());
+
+  TASK_END(startup);
+}
+
+bool performWait(int vector)
 {
+  static uint32_t color;
+  static int decay;
+  static int delta;
+
+  TASK_BEGIN(waiting);
+
   // Wipe the slate clean first.
   strand.wipeWithColor(0);
   strand.show();
 
   // Ensure we're not already being manipulated with buttons.
-  while (NOBODY != getConfirmedInputVector())
-    delay(1);
+  TASK_WAIT_UNTIL(waiting, vector == NOBODY);
 
   // Indicate power is available on the first pixel.
   // Otherwise you might forget you need to start pushing buttons.
   //
-  uint32_t color;
-  int decay = 0;
-  int delta = +1;
-  while (NOBODY == getConfirmedInputVector())
+  decay = 0;
+  delta = +1;
+  while (NOBODY == vector)
   {
     // The EVERYONE mode's special rainbow color is updated all the time.
     updateRainbow();
-    color = VocaloidColors[target];
+    color = VocaloidColors[startupTarget];
     
-    strand.setPixelColor(ACCESSORY_LENGTH, NeoStrand::Bright(color, decay));
+    character.setPixelColor(0, NeoStrand::Bright(color, decay));
     strand.show();
-    delay(1);
+    TASK_YIELD(waiting);
 
     // breathing pattern
     decay += delta;
@@ -269,53 +465,65 @@ int performWait(int target)
     }
   }
 
-  while (1)
+  do
   {
     // The EVERYONE mode's special rainbow color is updated all the time.
     updateRainbow();
-    color = VocaloidColors[target];
+    color = VocaloidColors[startupTarget];
 
-    strand.setPixelColor(ACCESSORY_LENGTH, color);
+    character.setPixelColor(0, color);
     strand.show();
-    delay(1);
+    TASK_YIELD(waiting);
 
-    int vector = getConfirmedInputVector();
-    if (vector == NOBODY)
-      break;
-    target = vector;
+    if (vector != NOBODY)
+      startupTarget = vector;
   }
+  while (vector != NOBODY);
 
   // We have poor entropy at power startup, but it is much better
   // if we can allow for some kind of user interaction before seeding.
   // So we seed the number generator after this first button push.
-  // Luckily, quality random numbers aren't too important here.
+  // Luckily, quality random numbers aren't too important here.  The
+  // entropy comes partly from analogRead(), which has to have the ADC to
+  // itself for a moment.
   //
-  randomSeed(getCheapEntropy());
+  dimmerKnob.stop();
+  sparkle.setSeed(getCheapEntropy());
+  dimmerKnob.begin(DIMMER_PIN - A0);
 
-  return target;
+  TASK_END(waiting);
 }
 
-int performBoot(int target)
+bool performBoot()
 {
-  int first = target;
-  int duration = 400;
+  static int first;
+  static int target;
+  static int duration;
+  static int decay;
+  static int i;
+  static uint32_t color;
+
+  TASK_BEGIN(booting);
+
+  first = startupTarget;
+  target = first;
+  duration = 400;
 
   // Slowly build up the distribution of sparkles.
   //
-  int decay = 0;
-  for (int i = 0; i < duration; i++)
+  decay = 0;
+  for (i = 0; i < duration; i++)
   {
     // The EVERYONE mode's special rainbow color is updated all the time.
     updateRainbow();
 
-    uint32_t color = VocaloidColors[target];
+    color = VocaloidColors[target];
     
-    int chance = random(duration);
-    if (chance < i)
+    if (sparkle.below(duration) < i)
     {
       decay = 255;
-      if (random(1000) < 50 && i < duration*7/8)
-        target = random(8);
+      if (sparkle.below(1000) < 50 && i < duration*7/8)
+        target = sparkle.below8(8);
       else
         target = first;
     }
@@ -326,7 +534,6 @@ int performBoot(int target)
       color = NeoStrand::Bright(color, decay);
     }
 
-    dimmer = updateDimmer();
     if (dimmer < 255)
       color = NeoStrand::Bright(color, dimmer);
 
@@ -336,18 +543,17 @@ int performBoot(int target)
 
     // Ramp in the speed of the cascade.
     //
-    int speed = map(i, 0, duration, 20, 1);
-    delay(speed);
+    TASK_DELAY(booting, map(i, 0, duration, 20, 1));
   }
   target = first;
 
   // Fade down into resting brightness level.
   //
   duration = 300;
-  for (int i = 0; i < duration+STRAND_LENGTH; i++)
+  for (i = 0; i < duration+STRAND_LENGTH; i++)
   {
-    uint32_t color = VocaloidColors[target];
-    int decay = map(i, 0, duration, 255, RESTING_BRIGHTNESS);
+    color = VocaloidColors[target];
+    decay = map(i, 0, duration, 255, RESTING_BRIGHTNESS);
     decay = constrain(decay, RESTING_BRIGHTNESS, 255);
     color = NeoStrand::Bright(color, decay);
     if (dimmer < 255)
@@ -355,14 +561,10 @@ int performBoot(int target)
     strand.scrollForward();
     strand.setPixelColor(0, color);
     strand.show();
-    delay(1);
+    TASK_YIELD(booting);
   }
 
-  // Past user input is irrelevant.
-  //
-  clearHistory();
-
-  return target;
+  TASK_END(booting);
 }
 
 //----------------------------------------------------------------------------
@@ -373,14 +575,20 @@ int performBoot(int target)
 //
 void loop()
 {
-  unsigned long now = millis();
+  // Wait for the next frame to be due, then send the strand the frame we
+  // decided on last time, so the frames appear at a steady rate.  Each
+  // frame is seen one frame period after it was decided, about 6ms at 160
+  // frames per second, which is steady and too short to notice.  First,
+  // make up for any time the clock missed while the strand was sending.
+  //
+  frameClock.compensate(strand.getStalledMicros());
+  strand.resetStalledMicros();
+  frameClock.waitForFrame();
+  strand.show();
 
   // Check if debugging has been requested.
   updateDebug();
 
-  // The EVERYONE mode's special rainbow color is updated all the time.
-  updateRainbow();
-
   // Update our overall brightness factor from a trim knob.
   dimmer = updateDimmer();
 
@@ -391,44 +599,58 @@ void loop()
   //
   int currentVector = getConfirmedInputVector();
 
-  // Any positive change in confirmed vector instantly changes the overall
-  // "mode" of our system to a new Vocaloid character, and feeds the new
-  // mode's color into the top of the strand.
-  //
   static int effect = SOLID;
   static int lastMode = EVERYONE;
-  if (currentVector != NOBODY)
-  {
-    mode = currentVector;
-    if (mode != lastMode)
-      effect = SOLID;
-  }
-
-  // Monitor the history of this input vector.  Certain timing patterns can
-  // be detected to select a sub-mode special effect.
-  //
-  int command = detectEffectCommand(currentVector);
-  if (command != NONE)
-    effect = command;
 
-  // Special combo of holding all buttons means to go dark instead.
+  // While the startup sequence runs, it has the strand all to itself.
   //
-  if (effect == SHUTDOWN)
+  if (startup.isRunning())
   {
-    strand.wipeWithColor(0, 1);
-    mode = performWait(mode);
-    mode = performBoot(mode);
-    clearHistory();
-    lastMode = NOBODY;
-    effect = SOLID;
+    if (performStartup(currentVector))
+    {
+      // Past user input is irrelevant.
+      //
+      mode = startupTarget;
+      clearHistory();
+      lastMode = NOBODY;
+      effect = SOLID;
+    }
   }
+  else
+  {
+    // The EVERYONE mode's special rainbow color is updated all the time.
+    updateRainbow();
 
-  updateStrand(mode, effect);
+    // Any positive change in confirmed vector instantly changes the
+    // overall "mode" of our system to a new Vocaloid character, and feeds
+    // the new mode's color into the top of the strand.
+    //
+    if (currentVector != NOBODY)
+    {
+      mode = currentVector;
+      if (mode != lastMode)
+        effect = SOLID;
+    }
 
-  // Tell the strand device we've finally decided what we want to display.
-  strand.show();
-  while (now == millis())
-    ;
+    // Monitor the history of this input vector.  Certain timing patterns
+    // can be detected to select a sub-mode special effect.
+    //
+    int command = detectEffectCommand(currentVector);
+    if (command != NONE)
+      effect = command;
+
+    // Special combo of holding all buttons means to go dark instead.  The
+    // strand is wiped to black and the startup sequence runs again.
+    //
+    if (effect == SHUTDOWN)
+    {
+      strand.startWipeWithColor(0, 1);
+      startupTarget = mode;
+      startup.start();
+    }
+    else
+      updateStrand(mode, effect);
+  }
 
   lastMode = mode;
 }
@@ -446,7 +668,7 @@ void loop()
 //
 void updateDebug()
 {
-  if (isButtonPressed(DEBUG_BUTTON))
+  if (!FastPin<DEBUG_BUTTON>::read())
   {
     // Print whatever you want back to the host computer.
     Serial.print("---\n");
@@ -454,14 +676,14 @@ void updateDebug()
     for (int i = 0; i < HISTORY_LENGTH; i++)
     {
       if (i > 0) Serial.print(", ");
-      Serial.print(history_vector[i]);
+      Serial.print(gestures.getVector(i));
     }
     Serial.print("};\n");
     Serial.print("history_time = {");
     for (int i = 0; i < HISTORY_LENGTH; i++)
     {
       if (i > 0) Serial.print(", ");
-      Serial.print(history_time[i]);
+      Serial.print(gestures.getTime(i));
     }
     Serial.print("};\n");
 
@@ -469,11 +691,37 @@ void updateDebug()
     Serial.print(dimmer);
     Serial.print(";\n");
 
+    // How many frames were actually sent to the strand, versus skipped
+    // because they were the same as the last one, since the last report.
+    Serial.print("frames shown = ");
+    Serial.print(strand.getShownFrames());
+    Serial.print(", skipped = ");
+    Serial.print(strand.getSkippedFrames());
+    Serial.print(", partial = ");
+    Serial.print(strand.getPartialFrames());
+    Serial.print(";\n");
+    strand.resetFrameCounts();
+
+    // How busy each frame was, in microseconds, and how many frames took
+    // longer than the frame period, since the last report.
+    Serial.print("frame us = ");
+    Serial.print(frameClock.getMinMicros());
+    Serial.print(" min, ");
+    Serial.print(frameClock.getMeanMicros());
+    Serial.print(" mean, ");
+    Serial.print(frameClock.getMaxMicros());
+    Serial.print(" max of ");
+    Serial.print(frameClock.getPeriod());
+    Serial.print(", overruns = ");
+    Serial.print(frameClock.getOverruns());
+    Serial.print(";\n");
+    frameClock.resetStats();
+
     // Wait for the debug button to be released, so as not to spam the
     // terminal with too much data.
     //
     delay(100);
-    while (isButtonPressed(DEBUG_BUTTON))
+    while (!FastPin<DEBUG_BUTTON>::read())
       ;
   }
 }
@@ -486,122 +734,69 @@ void updateDebug()
 // no lights.  We also don't want it to go too dark because the colors get
 // a bit inaccurate if scaled too low.
 //
+// The ADC reads the potentiometer by itself, and the knob only reports a
+// change when it has really moved, so the dimmer is only worked out again
+// then.
+//
 int updateDimmer()
 {
-    int trimmer = analogRead(DIMMER_PIN - A0);
-    dimmer = map(trimmer, 0, 1023, 100, 255);
+#ifndef ADCSRA
+    dimmerKnob.sample(analogRead(DIMMER_PIN - A0));
+#endif
+    if (dimmerKnob.hasChanged())
+      dimmer = map(dimmerKnob.read(), 0, 1023, 100, 255);
     return dimmer;
 }
 
-// Wipe the history arrays of all the past user input behavior.
+#ifdef ADCSRA
+ISR(ADC_vect) { dimmerKnob.sample(ADC); }
+#endif
+
+// Wipe the history of all the past user input behavior.
 //
 void clearHistory()
 {
-  memset(history_time, 0, sizeof(history_time));
-  memset(history_vector, 0, sizeof(history_vector));
-  history_millis = millis();
+  gestures.clear(millis());
+  confirmedMillis = millis();
 }
 
-// Check out the history arrays to see if the user has executed a triple-
-// tap of the same button vector combo.  If so, set up the PULSING effect.
+// When the user has tapped out a beat for the PULSING effect, set up the
+// beat to match.  The history looks like this:
 //
-int detectTripleTap()
-{
-#if HISTORY_LENGTH < 6
-#error Need more HISTORY_LENGTH to support detectTripleTap()
-#endif
-
-  // The vector history arrays need to match this pattern:
-  //
-  //                   < most recent                 least recent >
-  // history_vector:   [ NOBODY, x, NOBODY,     x, NOBODY, x, ... ]
-  // history_time:     [      ?, y,      w,     y,      w, ?, ... ]
-  //
-  // The 'y+w' times have to be approximately equal (within HISTORY_CYCLES).
-  // The pulse rate becomes defined as the average of the last two 'y+w'
-  // timespans.
-  //
-  if (history_vector[0] == NOBODY &&
-      history_vector[2] == NOBODY &&
-      history_vector[4] == NOBODY)
-  {
-    if (history_vector[1] == NOBODY)
-      return NONE;
-
-    if (history_vector[1] == history_vector[3] &&
-        history_vector[3] == history_vector[5])
-    {
-      unsigned long period0 = history_time[1]+history_time[2];
-      unsigned long period1 = history_time[3]+history_time[4];
-      if (period1 > period0 && period1-period0 > HISTORY_CYCLES)
-        return NONE;
-      if (period0 > period1 && period0-period1 > HISTORY_CYCLES)
-        return NONE;
-
-      pulsingPeriod = (period0+period1)/2;
-      return PULSING;
-    }
-  }
-
-  return NONE;
-}
-
-// Check out the history arrays to see if the user has executed a double-
-// tap of the same button vector combo.  If so, set up the SPARKLING
-// effect.
+//                   < most recent                 least recent >
+// vector:           [ NOBODY, x, NOBODY,     x, NOBODY, x, ... ]
+// time:             [      ?, y,      w,     y,      w, ?, ... ]
+//
+// The pulse rate becomes defined as the average of the last two 'y+w'
+// timespans.
 //
-int detectDoubleTap()
+void startPulsing()
 {
-#if HISTORY_LENGTH < 4
-#error Need more HISTORY_LENGTH to support detectDoubleTap()
-#endif
-
-  // The vector history arrays need to match this pattern:
-  //
-  //                   < most recent           least recent >
-  // history_vector:   [ NOBODY, x, NOBODY, x, ... ]
-  // history_time:     [      ?, ?,  short, ?, ... ]
+  // Only (re)start the beat once for each new triple-tap.  The phase
+  // starts counting from the moment the last tap was pressed.
   //
-  if (history_vector[0] == NOBODY && history_vector[2] == NOBODY)
-  {
-    if (history_vector[1] == NOBODY)
-      return NONE;
-
-    if (history_vector[1] == history_vector[3])
-    {
-      if (history_time[2] > HISTORY_CYCLES*2)
-        return NONE;
-
-      return SPARKLING;
-    }
-  }
-
-  return NONE;
+  if (pulsingOrigin == gestures.getMillis())
+    return;
+  unsigned long period0 = gestures.getTime(1) + gestures.getTime(2);
+  unsigned long period1 = gestures.getTime(3) + gestures.getTime(4);
+  unsigned long since = gestures.getTime(0);
+  pulsingOrigin = gestures.getMillis();
+  pulsingPeriod = (period0+period1)/2;
+  pulsingStep = getBeatStep(period0+period1);
+  pulsingPhase = pulsingStep * (since + gestures.getTime(1));
+  pulsingMillis = gestures.getMillis() + since;
 }
 
-// Check out the history arrays to see if the user has executed a long-
-// tap of the same button vector combo.  If so, set up the SHUTDOWN
-// effect.
+// Calculate the beat phase step per millisecond, for a beat period given
+// in half milliseconds:  2^33 divided by the doubled period, rounded to the
+// nearest step.  This is done with 32-bit math, since the 2^33 itself won't
+// fit, and only needs to be done once for each tempo.
 //
-int detectLongTap()
+unsigned long getBeatStep(unsigned long twice)
 {
-#if HISTORY_LENGTH < 2
-#error Need more HISTORY_LENGTH to support detectLongTap()
-#endif
-
-  // The vector history arrays need to match this pattern:
-  //
-  //                   < most recent   least recent >
-  // history_vector:   [ x,    ... ]
-  // history_time:     [ long, ... ]
-  //
-  if (history_vector[0] != NOBODY)
-  {
-    if (history_time[0] > HOLD_MODE_CYCLES)
-      return SHUTDOWN;
-  }
-
-  return NONE;
+  unsigned long quotient = 0xFFFFFFFFUL / twice;
+  unsigned long remainder = 0xFFFFFFFFUL % twice + 1;
+  return quotient*2 + (remainder*2 + twice/2) / twice;
 }
 
 // This routine records the recent history of user actions, and then
@@ -610,37 +805,19 @@ int detectLongTap()
 //
 int detectEffectCommand(int vector)
 {
-  unsigned long now = millis();
-
   // If the vector of input buttons has changed at all, we record
   // this change in the history.  The last HISTORY_LENGTH vector
   // states are kept.
   //
-  if (vector != history_vector[0])
-  {
-    // push the new vector onto the stack
-    memmove(&history_vector[1], &history_vector[0],
-            sizeof(*history_vector)*(HISTORY_LENGTH-1));
-    memmove(&history_time[1], &history_time[0],
-            sizeof(*history_time)*(HISTORY_LENGTH-1));
-    history_vector[0] = vector;
-    history_millis = now;
-  }
-
-  // The latest entry in the history is always counting upward from the
-  // last change.  Thus, when the next change is pressed onto the history,
-  // it represents the length of time there was no change.
+  // The change is recorded at the moment the buttons actually changed,
+  // not when this frame noticed it, so the tap timing is accurate to the
+  // millisecond.
   //
-  int since = (now - history_millis);
-  history_time[0] = since;
+  gestures.record(vector, inputMillis);
 
-  int effect = NONE;
-  if (effect == NONE)
-    effect = detectTripleTap();
-  if (effect == NONE)
-    effect = detectDoubleTap();
-  if (effect == NONE)
-    effect = detectLongTap();
+  int effect = gestures.recognize(millis());
+  if (effect == PULSING)
+    startPulsing();
 
   return effect;
 }
@@ -649,31 +826,47 @@ int detectEffectCommand(int vector)
 
 // Make any strand lighting updates desired.  This is based on a given
 // major character mode and also a special effect.  In our case, we rely
-// heavily on the NeoStrand's "scrollForward" function, to allow new
-// modes to appear at the top of the strand and smoothly wash down the
-// strand like a waterfall.
-// 
+// heavily on the strand's "scrollForward" function, to allow new
+// modes to appear at the top of the accessory and the character and
+// smoothly wash down each of them like a waterfall.
+//
 void updateStrand(int mode, int effect)
 {
   unsigned long now = millis();
 
   // Scroll the current mode down the strand at the appropriate speed.
-  static int heldScroll = 0;
-  heldScroll++;
-  if (heldScroll >= SCROLL_CYCLES)
+  // The top two pixels of the character and the accessory are usually
+  // still coming in, and show a blend of colors (see NeoFeed), so they are
+  // given the whole colors they came in with before they move.
+  //
+  // The whole strand scrolls at once, which only turns its ring buffer.
+  // The end of the accessory moves onto the top of the character, but
+  // every pixel that scrolled in at the top of either one is fed a new
+  // color below, so the two still look like separate waterfalls.
+  //
+  unsigned int steps = scrollClock.advance(frameClock.now());
+  uint8_t fraction = scrollClock.fraction();
+  if (steps)
   {
-    heldScroll = 0;
-    strand.scrollForward();
+    characterFeed.settle();
+#if ACCESSORY_LENGTH > 0
+    accessoryFeed.settle();
+#endif
+    strand.scrollForward(steps);
   }
 
-  // Grab the base color for the current character mode.
+  // Grab the colors for the current character mode, with the master
+  // dimmer already applied.
   //
-  uint32_t color = VocaloidColors[mode];
+  updateModeColors(mode);
+  uint32_t color = cachedColors.full;
 
   // Apply the correct effect as temporal variations of the base color.
+  // The effects give back colors with the master dimmer applied.
   //
   if (mode != EVERYONE && mode != NOBODY)
   {
+    color = VocaloidColors[mode];
     switch (effect)
     {
     default:
@@ -684,26 +877,20 @@ void updateStrand(int mode, int effect)
     }
   }
 
-  // Master dimmer applied last.
-  //
-  if (dimmer < 255)
-    color = NeoStrand::Bright(color, dimmer);
-
   // Give the final color to the top of the strand.
   //
-  strand.setPixelColor(ACCESSORY_LENGTH, color);
+  characterFeed.feed(steps, fraction, color);
 
 #if ACCESSORY_LENGTH > 0
 
   // Now grab the accent color for the current character mode.
   //
-  color = AccessoryColors[mode];
+  color = cachedColors.accessory;
 
   // Apply different effects to the accessory color.
   //
   static unsigned int heldAccessory = 0;
-  if (heldScroll == 0)
-    heldAccessory++;
+  heldAccessory += steps;
   int decay;
   switch (mode)
   {
@@ -720,24 +907,19 @@ void updateStrand(int mode, int effect)
     decay = map(heldAccessory % ACCESSORY_LENGTH,
                 0, ACCESSORY_LENGTH-1,
                 255, 100);
-    color = NeoStrand::Bright(color, decay);
+    color = applyDimmer(NeoStrand::Bright(AccessoryColors[mode], decay));
     break;
   
   case EVERYONE:
-    color = VocaloidColors[mode];
+    color = cachedColors.full;
     break;
   
   default: break;
   }
 
-  // Master dimmer applied last.
-  //
-  if (dimmer < 255)
-    color = NeoStrand::Bright(color, dimmer);
-
   // Give the final color to the top of the strand.
   //
-  strand.setPixelColor(0, color);
+  accessoryFeed.feed(steps, fraction, color);
 
 #endif
 }
@@ -745,110 +927,201 @@ void updateStrand(int mode, int effect)
 uint32_t applySolidEffect(uint32_t color, unsigned long now)
 {
   // Fresh color change is bright; fades to resting brightness soon after.
-  unsigned long since = now - history_millis;
-  if (history_vector[0] != NOBODY)
-    color = color;
+  // The fade is timed from when the change was confirmed, not from when
+  // the buttons moved, or most of it would pass before it is seen.
+  unsigned long since = now - confirmedMillis;
+  if (gestures.getVector(0) != NOBODY)
+    color = cachedColors.full;
   else if (since < 200)
-    color = strand.Bright(color, map(since, 0, 200, 255, RESTING_BRIGHTNESS));
+    color = applyDimmer(
+      strand.Bright(color, map(since, 0, 200, 255, RESTING_BRIGHTNESS)));
   else
-    color = strand.Bright(color, RESTING_BRIGHTNESS);
+    color = cachedColors.resting;
   return color;
 }
 
 uint32_t applyPulsingEffect(uint32_t color, unsigned long now)
 {
   // Right on the pulsing beat frequency is bright; fades to resting level.
-  unsigned long since = now - history_millis + history_time[1];
-  while (since > pulsingPeriod)
-    since -= pulsingPeriod;
-  if (history_vector[0] != NOBODY)
-    color = color;
+  // Advance the beat phase, then scale the top 16 bits of the phase back
+  // to milliseconds since the beat.
+  pulsingPhase += pulsingStep * (now - pulsingMillis);
+  pulsingMillis = now;
+  unsigned long since = ((pulsingPhase >> 16) * pulsingPeriod) >> 16;
+  if (gestures.getVector(0) != NOBODY)
+    color = cachedColors.full;
   else if (since < 200)
-    color = strand.Bright(color, map(since, 0, 200, 255, RESTING_BRIGHTNESS));
+    color = applyDimmer(
+      strand.Bright(color, map(since, 0, 200, 255, RESTING_BRIGHTNESS)));
   else
-    color = strand.Bright(color, RESTING_BRIGHTNESS);
+    color = cachedColors.resting;
   return color;
 }
 
 uint32_t applySparklingEffect(uint32_t color, unsigned long now)
 {
   // Jitter the brightness randomly.
-  color = strand.Bright(color, random(150, 255));
+  return applyDimmer(strand.Bright(color, sparkle.between(150, 255)));
 }
 
 uint32_t applyShutdownEffect(uint32_t color, unsigned long now)
 {
   // Nothing to do here.
+  return cachedColors.full;
+}
+
+// Master dimmer applied last.
+//
+uint32_t applyDimmer(uint32_t color)
+{
+  if (dimmer < 255)
+    color = NeoStrand::Bright(color, dimmer);
+  return color;
+}
+
+// Work out the dimmed colors for the mode again, if the mode, the dimmer
+// or the mode's colors have changed since last time.  Comparing the colors
+// themselves also catches every step of the EVERYONE rainbow.
+//
+void updateModeColors(int mode)
+{
+  uint32_t base = VocaloidColors[mode];
+  uint32_t accent = AccessoryColors[mode];
+  if (mode == cachedColors.mode && dimmer == cachedColors.dimmer &&
+      base == cachedColors.base && accent == cachedColors.accent)
+    return;
+  cachedColors.mode = mode;
+  cachedColors.dimmer = dimmer;
+  cachedColors.base = base;
+  cachedColors.accent = accent;
+  cachedColors.full = applyDimmer(base);
+  cachedColors.resting =
+    applyDimmer(NeoStrand::Bright(base, RESTING_BRIGHTNESS));
+  cachedColors.accessory = applyDimmer(accent);
 }
 
 // This function keeps track of a cycling hue that is used to generate a
-// prismatic rainbow effect.  It uses the NeoStrand "wheel" function to
-// calculate a rainbow color.
+// prismatic rainbow effect.  It uses the NeoStrand HSV function to
+// calculate a rainbow color.  The hue has 256 steps for every one the old
+// color wheel had, so it moves a little on every frame instead of
+// holding each color for RAINBOW_CYCLES frames.
 //
 void updateRainbow()
 {
-  static uint8_t wheel = 0;
-  static int heldWheel = 0;
-  
-  heldWheel++;
-  if (heldWheel >= RAINBOW_CYCLES)
-  {
-    wheel++;
-    heldWheel = 0;
-    VocaloidColors[EVERYONE] = strand.Wheel(wheel);
-  }
+  static uint16_t hue = 0;
+
+  hue += 256 / RAINBOW_CYCLES;
+  VocaloidColors[EVERYONE] = strand.ColorHSV(hue);
+}
+
+// Read all three buttons' pressed/unpressed status, and combine them into
+// one number called an input vector.  The button bank knows which port
+// each button is on when the sketch is compiled, and samples all the
+// buttons on a port at once (see Generic.h).
+//
+int readButtonVector()
+{
+  return buttons.read();
+}
+
+// Queue the input vector whenever it changes, along with the time it
+// changed.  This is called by the pin change interrupts, or once per frame
+// on boards where we don't set those up.  No input vector has all eight
+// bits set, so the first call, from setup(), always queues the buttons as
+// they are at power on, even if some are already held.
+//
+void captureButtons()
+{
+  static uint8_t lastVector = 0xFF;
+  uint8_t vector = readButtonVector();
+  if (vector == lastVector)
+    return;
+  lastVector = vector;
+  ButtonEvent event = { millis(), vector };
+  if (!buttonEvents.push(event))
+    buttonOverflow = true;
 }
 
+#ifdef PCICR
+
+// Let a button's pin trigger its port's pin change interrupt.  On an
+// Arduino Uno, pins 8~13 share PCINT0, A0~A5 share PCINT1, and 0~7 share
+// PCINT2.  All three handlers do the same thing, so the buttons can be on
+// any pins.
+//
+void enableButtonInterrupt(uint8_t pin)
+{
+  *digitalPinToPCMSK(pin) |= bit(digitalPinToPCMSKbit(pin));
+  PCIFR |= bit(digitalPinToPCICRbit(pin));
+  PCICR |= bit(digitalPinToPCICRbit(pin));
+}
+
+ISR(PCINT0_vect) { captureButtons(); }
+ISR(PCINT1_vect) { captureButtons(); }
+ISR(PCINT2_vect) { captureButtons(); }
+
+#endif
+
 // Get the total combination of button presses at the current instant.
 // This function performs two important features.
 //
-// (1) combine all three buttons' pressed/unpressed status into one number
-//     called an input vector
+// (1) collect the input vector changes captured by captureButtons()
+//
+// (2) don't accept a change in the input vector until it has been held for
+//     CONFIRMATION_MILLIS; this makes it easier for the user to go from
+//     zero buttons pressed to two buttons pressed even if they don't get
+//     pressed at the exact same instant, and ignores electric bounces
 //
-// (2) don't accept a change in the input vector until a certain confirmation
-//     time has elapsed; this makes it easier for the user to go from zero
-//     buttons pressed to two buttons pressed even if they don't get pressed
-//     at the exact same instant
+// The time of the last change before the confirmed vector was held steady
+// is kept in inputMillis, and the time it was confirmed in confirmedMillis.
 //
-// Lastly, we flicker the onboard LED on the Arduino, just to show that
-// there is some activity on the buttons.  This is very useful during the
-// breadboard stage when you're not sure if the circuit is wrong or the
-// software has crashed.
+// Lastly, we light the onboard LED on the Arduino while a change is still
+// waiting to be confirmed, just to show that there is some activity on the
+// buttons.  This is very useful during the breadboard stage when you're
+// not sure if the circuit is wrong or the software has crashed.
 //
 int getConfirmedInputVector()
 {
   static int lastConfirmedVector = NOBODY;
-  static int lastVector = -1;
-  static int heldVector = 0;
+  static int rawVector = NOBODY;
+  static unsigned long rawMillis = 0;
 
-  // Combine the inputs.
-  int rawVector =
-    isButtonPressed(LUKA_BUTTON) << 2 |
-    isButtonPressed(TWIN_BUTTON) << 1 |
-    isButtonPressed(MIKU_BUTTON) << 0;
+#ifndef PCICR
+  captureButtons();
+#endif
 
-  // On a change in vector, don't return the new one!
-  // Instead, flicker the light and return the OLD one.
+  // Catch up with every change since the last frame.
   //
-  if (rawVector != lastVector)
+  ButtonEvent event;
+  while (buttonEvents.pop(event))
   {
-    heldVector = 0;
-    lastVector = rawVector;
-    digitalWrite(13, HIGH);
-    return lastConfirmedVector;
+    rawVector = event.vector;
+    rawMillis = event.millis;
   }
-  digitalWrite(13, LOW);
-  
+  if (buttonOverflow)
+  {
+    buttonOverflow = false;
+    rawVector = readButtonVector();
+    rawMillis = millis();
+  }
+
   // We only update the confirmed vector after it has
   // been held steady for long enough to rule out any
   // accidental/sloppy half-presses or electric bounces.
   //
-  heldVector++;
-  if (heldVector >= CONFIRMATION_CYCLES)
+  if (millis() - rawMillis < CONFIRMATION_MILLIS)
+  {
+    digitalWrite(13, HIGH);
+    return lastConfirmedVector;
+  }
+  digitalWrite(13, LOW);
+
+  if (rawVector != lastConfirmedVector)
   {
     lastConfirmedVector = rawVector;
+    inputMillis = rawMillis;
+    confirmedMillis = millis();
   }
 
   return lastConfirmedVector;
 }
-
@@ -0,0 +1,95 @@
+// Host benchmark comparing per-pixel Bright() calls with scaleRange().
+//
+// bench_bright.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+
+#include <stdio.h>
+#include <chrono>
+
+#include "NeoStrand.h"
+
+//----------------------------------------------------------------------------
+
+// Dimming a whole strand the old way means unpacking every pixel into a
+// color, calling Bright(), and packing it back into the buffer.
+//
+static void dimWithBright(NeoStrand& strand, uint8_t scale)
+{
+  for (uint16_t i = 0; i < strand.numPixels(); i++)
+    strand.setPixelColor(i, NeoStrand::Bright(strand.getPixelColor(i), scale));
+}
+
+static void dimWithScaleRange(NeoStrand& strand, uint8_t scale)
+{
+  strand.scaleRange(0, strand.numPixels(), scale);
+}
+
+// Refill the strand with a rainbow between passes, so the pixels never
+// fade all the way to black.  Returns nanoseconds per pass, not counting
+// the refill.
+//
+static double measure(NeoStrand& strand, void (*dim)(NeoStrand&, uint8_t))
+{
+  typedef std::chrono::steady_clock clock;
+  const int passes = 2000;
+  clock::duration total = clock::duration::zero();
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (uint16_t i = 0; i < strand.numPixels(); i++)
+      strand.setPixelColor(i, NeoStrand::Wheel(i + pass));
+    clock::time_point start = clock::now();
+    dim(strand, 200);
+    total += clock::now() - start;
+  }
+  return std::chrono::duration<double, std::nano>(total).count() / passes;
+}
+
+static bool sameResults(uint16_t length, neoPixelType type)
+{
+  NeoStrand a(length, 6, type);
+  NeoStrand b(length, 6, type);
+  for (uint16_t i = 0; i < length; i++)
+  {
+    a.setPixelColor(i, NeoStrand::Wheel(i) | ((uint32_t)i << 24));
+    b.setPixelColor(i, NeoStrand::Wheel(i) | ((uint32_t)i << 24));
+  }
+  dimWithBright(a, 77);
+  dimWithScaleRange(b, 77);
+  return !memcmp(a.getPixels(), b.getPixels(), length * (type == NEO_GRBW? 4 : 3));
+}
+
+//----------------------------------------------------------------------------
+
+int main()
+{
+  static const uint16_t lengths[] = { 16, 60, 160, 300, 1024 };
+  static const neoPixelType types[] = { NEO_GRB, NEO_GRBW };
+
+  printf("%-5s %6s %14s %14s %8s\n",
+         "type", "pixels", "Bright() ns", "scaleRange ns", "speedup");
+  for (unsigned t = 0; t < sizeof(types)/sizeof(*types); t++)
+  {
+    for (unsigned l = 0; l < sizeof(lengths)/sizeof(*lengths); l++)
+    {
+      if (!sameResults(lengths[l], types[t]))
+      {
+        printf("scaleRange() does not match Bright() for %u pixels\n", lengths[l]);
+        return 1;
+      }
+      NeoStrand strand(lengths[l], 6, types[t] + NEO_KHZ800);
+      double bright = measure(strand, dimWithBright);
+      double range = measure(strand, dimWithScaleRange);
+      printf("%-5s %6u %14.0f %14.0f %7.1fx\n",
+             types[t] == NEO_GRBW? "GRBW" : "GRB", lengths[l],
+             bright, range, bright / range);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,247 @@
+// Host benchmark of the NeoStrand primitives, with results in JSON.
+//
+// bench_primitives.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// Each primitive is timed on strands of 16 to 1024 pixels, with three
+// (GRB) and four (GRBW) bytes per pixel, both as a NeoStrand with its
+// buffer from malloc() and as a NeoStrandT with the layout fixed when
+// compiled, which is how the sketch declares its strand.  Scrolls are
+// timed with and without the ring buffer.  Bright() and Wheel() are timed
+// over a whole strand, the way the effects use them:  reading, dimming
+// and storing every pixel, or storing a wheel color in every pixel.  The
+// wipes include show(), which the stand-in library only accounts for, so
+// their time is the checksum and the copying, not the 30us per pixel a
+// real strand takes.  getConfirmedInputVector() comes from the sketch
+// itself (see prototypes.awk), with the buttons held still, and with them
+// changing before every call.
+//
+// Every result is the fastest of several runs, in nanoseconds per call,
+// written to the standard output as one JSON object, so runs from before
+// and after a change can be compared with any JSON tool.  These are host
+// timings, not AVR cycles, so only compare runs from the same computer,
+// and don't read them as what a frame costs on a board:
+//
+//   build/bench_primitives > before.json
+//
+// Counting AVR cycles would take a build with avr-gcc, run under a cycle
+// counting simulator such as simavr; nothing here does that.
+//
+
+#include <stdio.h>
+#include <chrono>
+
+#include "NeoStrand.h"
+
+int getConfirmedInputVector();
+
+//----------------------------------------------------------------------------
+
+// Keep the compiler from throwing away the work we time.
+static volatile uint32_t sink;
+
+// Time a kernel by calling it over and over for about a millisecond, and
+// keep the fastest of several tries, since anything else running on the
+// host only ever makes a try slower.  Returns nanoseconds per call.
+//
+template <class Kernel>
+static double measure(Kernel& kernel)
+{
+  typedef std::chrono::steady_clock clock;
+  const int tries = 7;
+  long calls = 1;
+  double best = 0;
+  for (int t = 0; t < tries; t++)
+  {
+    clock::duration total;
+    for (;;)
+    {
+      clock::time_point start = clock::now();
+      for (long i = 0; i < calls; i++)
+        kernel(i);
+      total = clock::now() - start;
+      if (t || total >= std::chrono::milliseconds(1))
+        break;
+      calls *= 2;
+    }
+    double ns = std::chrono::duration<double, std::nano>(total).count() / calls;
+    if (!t || ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+// Each result is one object in the "results" array.
+//
+static bool firstResult = true;
+
+static void report(const char* kernel, const char* strand, const char* layout,
+                   uint16_t pixels, bool ring, double ns)
+{
+  printf("%s\n    { \"kernel\": \"%s\", \"strand\": \"%s\", \"layout\": \"%s\", "
+         "\"pixels\": %u, \"ring\": %s, \"ns\": %.1f }",
+         firstResult? "" : ",", kernel, strand, layout, pixels,
+         ring? "true" : "false", ns);
+  firstResult = false;
+}
+
+//----------------------------------------------------------------------------
+
+// The kernels, each working on any kind of strand.  The colors change from
+// call to call, so show() always has a new frame to send.
+//
+template <class S>
+struct BrightKernel
+{
+  S& strand;
+  void operator()(long i)
+  {
+    uint8_t scale = 200 + (i & 31);
+    for (uint16_t n = 0; n < strand.numPixels(); n++)
+      strand.setPixelColor(n, NeoStrand::Bright(strand.getPixelColor(n), scale));
+  }
+};
+
+template <class S>
+struct WheelKernel
+{
+  S& strand;
+  void operator()(long i)
+  {
+    for (uint16_t n = 0; n < strand.numPixels(); n++)
+      strand.setPixelColor(n, NeoStrand::Wheel(n + i));
+  }
+};
+
+template <class S>
+struct ScrollForwardKernel
+{
+  S& strand;
+  void operator()(long i) { strand.scrollForward(1, NeoStrand::Wheel(i)); }
+};
+
+template <class S>
+struct ScrollBackwardKernel
+{
+  S& strand;
+  void operator()(long i) { strand.scrollBackward(1, NeoStrand::Wheel(i)); }
+};
+
+template <class S>
+struct WipeColorKernel
+{
+  S& strand;
+  void operator()(long i)
+  {
+    delay(1);
+    strand.wipeWithColor(NeoStrand::Wheel(i));
+  }
+};
+
+template <class S>
+struct WipeRainbowKernel
+{
+  S& strand;
+  void operator()(long i)
+  {
+    delay(1);
+    strand.wipeWithRainbow(i);
+  }
+};
+
+template <class S>
+static void fillStrand(S& strand)
+{
+  for (uint16_t n = 0; n < strand.numPixels(); n++)
+    strand.setPixelColor(n, NeoStrand::Wheel(n * 7));
+}
+
+template <template <class> class Kernel, class S>
+static void run(const char* name, S& strand, const char* kind,
+                const char* layout, bool ring)
+{
+  strand.setRingBuffer(ring);
+  fillStrand(strand);
+  Kernel<S> kernel = { strand };
+  double ns = measure(kernel);
+  sink = strand.getPixelColor(0);
+  report(name, kind, layout, strand.numPixels(), ring, ns);
+}
+
+template <class S>
+static void runAll(S& strand, const char* kind, const char* layout)
+{
+  strand.begin();
+  run<BrightKernel>("Bright", strand, kind, layout, false);
+  run<WheelKernel>("Wheel", strand, kind, layout, false);
+  run<ScrollForwardKernel>("scrollForward", strand, kind, layout, false);
+  run<ScrollForwardKernel>("scrollForward", strand, kind, layout, true);
+  run<ScrollBackwardKernel>("scrollBackward", strand, kind, layout, false);
+  run<ScrollBackwardKernel>("scrollBackward", strand, kind, layout, true);
+  run<WipeColorKernel>("wipeWithColor", strand, kind, layout, false);
+  run<WipeRainbowKernel>("wipeWithRainbow", strand, kind, layout, false);
+}
+
+// A NeoStrandT has its length and layout as template arguments, so each
+// one has to be named when compiled.
+//
+template <uint16_t LENGTH>
+static void runLength()
+{
+  NeoStrand grb(LENGTH, 6, NEO_GRB + NEO_KHZ800);
+  runAll(grb, "NeoStrand", "GRB");
+  NeoStrand grbw(LENGTH, 6, NEO_GRBW + NEO_KHZ800);
+  runAll(grbw, "NeoStrand", "GRBW");
+  static NeoStrandT<LENGTH, 6> fixedGrb;
+  runAll(fixedGrb, "NeoStrandT", "GRB");
+  static NeoStrandT<LENGTH, 6, NEO_GRBW + NEO_KHZ800> fixedGrbw;
+  runAll(fixedGrbw, "NeoStrandT", "GRBW");
+}
+
+//----------------------------------------------------------------------------
+
+// The sketch's three mode buttons are on pins 9, 8 and 7, all on port B
+// except pin 7, which is on port D.
+//
+struct InputKernel
+{
+  bool changing;
+  void operator()(long i)
+  {
+    if (changing)
+      PINB = (i & 1)? 0xFF : 0xFD;
+    sink = getConfirmedInputVector();
+  }
+};
+
+static void runInput(bool changing)
+{
+  PINB = PINC = PIND = 0xFF;
+  InputKernel kernel = { changing };
+  double ns = measure(kernel);
+  report(changing? "getConfirmedInputVector changing" :
+                   "getConfirmedInputVector", "sketch", "", 0, false, ns);
+}
+
+//----------------------------------------------------------------------------
+
+int main()
+{
+  printf("{\n  \"units\": \"host ns per call\",\n"
+         "  \"note\": \"host timings, not AVR cycles\",\n  \"results\": [");
+  runLength<16>();
+  runLength<60>();
+  runLength<160>();
+  runLength<300>();
+  runLength<1024>();
+  runInput(false);
+  runInput(true);
+  printf("\n  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Shared parts of the host checks.
+//
+// check.h
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// Each check_*.cpp keeps a plain reference model of one feature, and uses
+// these to drive it:  a random number generator which gives the same run
+// every time, random colors and times, the bytes the stand-in library
+// captured on the wire, and a loop of random steps which stops at the
+// first one where the code and the model disagree.
+//
+
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdio.h>
+
+#include "NeoStrand.h"
+
+//----------------------------------------------------------------------------
+
+static FastRandom32 dice(0x5EED);
+
+// A random color, with or without the white channel.
+//
+inline uint32_t randomColor(uint32_t mask = 0xFFFFFFFF)
+{
+  return (((uint32_t)dice.next16() << 16) | dice.next16()) & mask;
+}
+
+// A random time (or any amount) from 0 up to just under longest, which
+// may be more than below() can take.
+//
+inline unsigned long randomUpTo(unsigned long longest)
+{
+  return (unsigned long long)dice.next16() * longest >> 16;
+}
+
+//----------------------------------------------------------------------------
+
+// Forget the bytes captured on a pin.  A frame which hasn't changed is not
+// sent again, so clear the strand too, and the wire matches it either way.
+//
+inline void clearWire(uint8_t pin)
+{
+  memset(&hostWire(pin), 0, sizeof(HostWire));
+}
+
+// The color pixel n was last sent as, from GRB or GRBW bytes.
+//
+inline uint32_t sentColor(uint8_t pin, uint16_t n, uint8_t stride)
+{
+  const uint8_t* sent = hostWire(pin).bytes + n * stride;
+  uint8_t w = (stride == 4)? sent[3] : 0;
+  return NeoStrand::Color(sent[1], sent[0], sent[2], w);
+}
+
+//----------------------------------------------------------------------------
+
+// Call step(i) for each of a number of steps, until one returns false,
+// and say which one that was.
+//
+template <class STEP>
+bool runSteps(const char* name, int steps, STEP step)
+{
+  for (int i = 0; i < steps; i++)
+  {
+    if (!step(i))
+    {
+      printf("%s does not match after step %d\n", name, i);
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+#endif // __CHECK_H__
@@ -0,0 +1,250 @@
+// Host check of the Generic.h frame and scroll clocks against plain timelines.
+//
+// check_clocks.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// The clock runs on the stand-in virtual clock, and each frame is kept
+// busy for a random time, sometimes longer than the frame period, and
+// sometimes with time said to be missed during show().  A plain timeline
+// works out when each frame should start, and what the statistics should
+// be.  Reading the virtual clock moves it on by a microsecond, so a frame
+// may start a few microseconds after it was due, but never before.
+//
+// The scroll clock is asked at random times, sometimes after a long pause,
+// at random speeds.  A plain 64-bit total of the distance moved, in
+// millionths of a pixel, gives the whole pixels and the fraction each time.
+//
+// A NeoFeed is driven by the scroll clock, with white pulses fed in for a
+// single step, and the light of each is followed from pixel 0 to pixel 1.
+//
+
+#include "check.h"
+
+//----------------------------------------------------------------------------
+
+// What the frame clock should have seen, worked out one frame at a time.
+//
+struct Timeline
+{
+  bool started;
+  unsigned long period;
+  unsigned long deadline;
+  unsigned long lastStart;
+  unsigned long frames;
+  unsigned long overruns;
+  unsigned long minBusy;
+  unsigned long maxBusy;
+  unsigned long totalBusy;
+
+  // A frame asked to wait at time t; returns when it is due.
+  unsigned long due(unsigned long t)
+  {
+    if (!started)
+    {
+      started = true;
+      return deadline = t;
+    }
+    unsigned long busy = t - lastStart;
+    frames++;
+    totalBusy += busy;
+    if (busy > period)
+      overruns++;
+    if (frames == 1 || busy < minBusy)
+      minBusy = busy;
+    if (busy > maxBusy)
+      maxBusy = busy;
+    deadline += period;
+    if (t > deadline + period)
+      deadline = t;
+    return deadline;
+  }
+};
+
+static bool checkFrames(unsigned int rate, unsigned long longest)
+{
+  FrameClock clock(rate);
+  Timeline timeline = { false, clock.getPeriod(), 0, 0, 0, 0, 0, 0, 0 };
+  unsigned long missed = 0;
+  hostMicros() = 1000;
+  char label[40];
+  snprintf(label, sizeof(label), "frame clock at %u fps", rate);
+  bool ok = runSteps(label, 20000, [&](int)
+  {
+    unsigned long t = hostMicros() + missed;
+    unsigned long due = timeline.due(t);
+    clock.waitForFrame();
+    // The clock read its start just before the last tick of the clock.
+    unsigned long start = hostMicros() - 1 + missed;
+    if (start < due || start > ((t > due)? t : due) + 3)
+    {
+      printf("started at %lu, due at %lu: ", start, due);
+      return false;
+    }
+    timeline.lastStart = start;
+    hostAdvance(randomUpTo(longest));
+    if (dice.below(8) == 0)
+    {
+      unsigned long stall = dice.below(3000);
+      clock.compensate(stall);
+      missed += stall;
+    }
+    return true;
+  });
+  if (!ok)
+    return false;
+  if (clock.getFrames() != timeline.frames ||
+      clock.getOverruns() != timeline.overruns ||
+      clock.getMinMicros() != timeline.minBusy ||
+      clock.getMaxMicros() != timeline.maxBusy ||
+      clock.getMeanMicros() != timeline.totalBusy / timeline.frames)
+  {
+    printf("statistics at %u fps don't match:  %lu/%lu frames, "
+           "%lu/%lu overruns, %lu/%lu min, %lu/%lu max, %lu/%lu mean\n",
+           rate, clock.getFrames(), timeline.frames,
+           clock.getOverruns(), timeline.overruns,
+           clock.getMinMicros(), timeline.minBusy,
+           clock.getMaxMicros(), timeline.maxBusy,
+           clock.getMeanMicros(), timeline.totalBusy / timeline.frames);
+    return false;
+  }
+  printf("%4u fps, busy up to %6lu us:  %lu frames, %lu overruns ok\n",
+         rate, longest, timeline.frames, timeline.overruns);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+// A rate of 0 would divide by zero, so it is taken as 1.
+//
+static bool checkRates()
+{
+  static const unsigned int rates[] = { 0, 1, 60, 160, 1000 };
+  for (unsigned r = 0; r < countof(rates); r++)
+  {
+    unsigned long period = FrameClock(rates[r]).getPeriod();
+    if (period != 1000000UL / (rates[r]? rates[r] : 1))
+    {
+      printf("a rate of %u gives a period of %lu us\n", rates[r], period);
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+static bool checkScrolling(unsigned int speed, unsigned long longest)
+{
+  ScrollClock clock(speed);
+  unsigned long now = dice.next16() * 1000UL;
+  clock.start(now);
+  unsigned long long total = 0;
+  unsigned long pixels = 0;
+  char label[40];
+  snprintf(label, sizeof(label), "scroll clock at %u pixels/s", speed);
+  bool ok = runSteps(label, 50000, [&](int)
+  {
+    unsigned long elapsed = randomUpTo(longest);
+    if (dice.below(64) == 0)
+      elapsed = 40000 + dice.below(30000);
+    now += elapsed;
+    total += ((elapsed > 50000)? 50000 : elapsed) * (unsigned long long)speed;
+    unsigned int steps = clock.advance(now);
+    uint8_t fraction = total % 1000000 * 256 / 1000000;
+    if (pixels + steps != total / 1000000 || clock.fraction() != fraction)
+    {
+      printf("moved %lu+%u with %u/256, not %llu with %u/256: ",
+             pixels, steps, clock.fraction(), total / 1000000, fraction);
+      return false;
+    }
+    pixels += steps;
+    return true;
+  });
+  if (!ok)
+    return false;
+  printf("%5u pixels/s, asked up to %5lu us apart:  %lu pixels ok\n",
+         speed, longest, pixels);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+// A color fed in for only one step must share its light between the top
+// two pixels, with the same total all the way, and a centre which follows
+// the scroll clock's fraction steadily from pixel 0 to pixel 1.
+//
+static bool checkFeeding(unsigned int speed, unsigned long longest)
+{
+  NeoStrand strand(8, 6, NEO_GRB + NEO_KHZ800);
+  NeoFeed<NeoStrand> feed(strand);
+  ScrollClock clock(speed);
+  unsigned long now = 0;
+  clock.start(now);
+  bool pulse = false;
+  int centre = -1;
+  unsigned long pulses = 0;
+  char label[40];
+  snprintf(label, sizeof(label), "feeding at %u pixels/s", speed);
+  bool ok = runSteps(label, 50000, [&](int)
+  {
+    now += randomUpTo(longest);
+    unsigned int steps = clock.advance(now);
+    if (steps)
+    {
+      feed.settle();
+      strand.scrollForward(steps);
+    }
+    // Now and then, a pulse is fed in on a single step, and followed
+    // until the next step moves it on past pixel 1.  The step before it
+    // must be dark, or pixel 1 would still hold the last pulse.
+    bool start = (steps == 1 && !pulse && !dice.below(4));
+    feed.feed(steps, clock.fraction(), start? 0xFFFFFF : 0);
+    if (steps)
+      pulse = false;
+    if (start)
+    {
+      pulse = true;
+      centre = -1;
+      pulses++;
+    }
+    if (start || !pulse)
+      return true;
+    int top = NeoStrand::Red(strand.getPixelColor(0));
+    int next = NeoStrand::Red(strand.getPixelColor(1));
+    int want = clock.fraction() + (clock.fraction() >> 7);
+    if (abs(top + next - 255) > 1 || abs(next - want) > 1 || next < centre)
+    {
+      printf("split %d and %d at %u/256: ", top, next, clock.fraction());
+      return false;
+    }
+    centre = next;
+    return true;
+  });
+  if (!ok)
+    return false;
+  printf("%5u pixels/s, fed up to %5lu us apart:  %lu pulses ok\n",
+         speed, longest, pulses);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+int main()
+{
+  bool ok = checkRates() &&
+            checkFrames(160, 3000) && checkFrames(160, 12000) &&
+            checkFrames(60, 40000) && checkFrames(1000, 900) &&
+            checkFrames(20, 150000) &&
+            checkScrolling(80, 6250) && checkScrolling(80, 40000) &&
+            checkScrolling(7, 16667) && checkScrolling(1000, 1000) &&
+            checkScrolling(65535, 6250) &&
+            checkFeeding(80, 6250) && checkFeeding(7, 16667) &&
+            checkFeeding(200, 1000);
+  return ok? 0 : 1;
+}
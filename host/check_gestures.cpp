@@ -0,0 +1,190 @@
+// Host check of the Generic.h gesture recognizer against a plain matcher.
+//
+// check_gestures.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// Random button presses and releases, of random lengths, are recorded by
+// recognizers of a few history lengths, and checked frame by frame.  The
+// plain matcher keeps the whole history, and checks every gesture of the
+// table against it from scratch, every time.  One table uses all sixteen
+// gestures the recognizer can hold, so the last bit of the mask is used.
+//
+
+#include "check.h"
+
+//----------------------------------------------------------------------------
+
+// Taps and holds, like those of the sketch, and a steady triple tap.
+//
+static const Gesture Taps[] PROGMEM =
+{
+  { 1, GESTURE_MS(250), 6,
+    { { 0, 0, 0 }, { GESTURE_TAP, 0, 0 },
+      { 0, 0, 0 }, { GESTURE_TAP, 0, 0 },
+      { 0, 0, 0 }, { GESTURE_TAP, 0, 0 } } },
+  { 2, 0, 4,
+    { { 0, 0, 0 }, { GESTURE_TAP, 0, 0 },
+      { 0, 0, GESTURE_MS(500) }, { GESTURE_TAP, 0, 0 } } },
+  { 3, 0, 3,
+    { { GESTURE_TAP, GESTURE_MS(1000), 0 },
+      { 0, 0, 0 }, { GESTURE_TAP, 0, 0 } } },
+  { 4, 0, 3, { { 0, 0, 0 }, { 1, 0, 0 }, { 2, 0, 0 } } },
+  { 5, 0, 1, { { GESTURE_TAP, GESTURE_MS(800), 0 } } },
+};
+
+// Every one of the sixteen holds a combination of buttons for a window of
+// time, the later ones only matching what the earlier ones do not.
+//
+#define WINDOW(result, vector, least, most) \
+  { result, 0, 2, { { 0, 0, 0 }, { vector, GESTURE_MS(least), \
+                                   GESTURE_MS(most) } } }
+
+static const Gesture Windows[] PROGMEM =
+{
+  WINDOW(1, 1, 0, 200), WINDOW(2, 2, 0, 200),
+  WINDOW(3, 3, 0, 200), WINDOW(4, 4, 0, 200),
+  WINDOW(5, 1, 200, 400), WINDOW(6, 2, 200, 400),
+  WINDOW(7, 3, 200, 400), WINDOW(8, 4, 200, 400),
+  WINDOW(9, 1, 400, 800), WINDOW(10, 2, 400, 800),
+  WINDOW(11, 3, 400, 800), WINDOW(12, 4, 400, 800),
+  WINDOW(13, 1, 800, 0), WINDOW(14, 2, 800, 0),
+  WINDOW(15, 3, 800, 0), { 16, 0, 1, { { 4, GESTURE_MS(300), 0 } } },
+};
+
+// The whole history of input vectors, and when each one started.
+//
+struct Reference
+{
+  enum { ENTRIES = 4000 };
+  uint8_t vectors[ENTRIES];
+  unsigned long starts[ENTRIES];
+  int count;
+
+  // Entry i back from the latest, and how long it was held, as long as a
+  // recognizer of the given length has seen it.  Before anything was
+  // recorded, every entry is nothing held for no time.
+  uint8_t vector(int i) const
+  {
+    return (count - 1 - i >= 0)? vectors[count - 1 - i] : 0;
+  }
+  unsigned long held(int i, unsigned long now) const
+  {
+    int e = count - 1 - i;
+    if (e < 0)
+      return 0;
+    unsigned long end = i? starts[e + 1] : now;
+    unsigned long time = end - starts[e];
+    return (i && time > 0xFFFF)? 0xFFFF : time;
+  }
+
+  bool matches(const Gesture& gesture, int length, unsigned long now) const
+  {
+    if (gesture.length > length)
+      return false;
+    uint8_t tap = 0;
+    for (int i = 0; i < gesture.length; i++)
+    {
+      const GestureStep& step = gesture.steps[i];
+      uint8_t v = vector(i);
+      if (step.vector == GESTURE_TAP)
+      {
+        if (!v || (tap && v != tap))
+          return false;
+        tap = v;
+      }
+      else if (v != step.vector)
+        return false;
+      unsigned long time = held(i, now);
+      if (time < step.least * 10UL ||
+          (step.most && time > step.most * 10UL))
+        return false;
+    }
+    if (!gesture.steady)
+      return true;
+    long first = -1;
+    for (int i = 1; i + 1 < gesture.length; i++)
+    {
+      if (gesture.steps[i].vector != GESTURE_TAP)
+        continue;
+      long period = (long)held(i, now) + held(i + 1, now);
+      if (first < 0)
+        first = period;
+      else if (labs(period - first) > gesture.steady * 10L)
+        return false;
+    }
+    return true;
+  }
+
+  uint8_t recognize(const Gesture* table, int count, int length,
+                    unsigned long now) const
+  {
+    for (int g = 0; g < count; g++)
+      if (matches(table[g], length, now))
+        return table[g].result;
+    return 0;
+  }
+};
+
+template <uint8_t LENGTH, size_t COUNT>
+static bool check(const char* name, const Gesture (&table)[COUNT])
+{
+  GestureRecognizer<LENGTH> recognizer(table);
+  unsigned long now = 5000;
+  recognizer.clear(now);
+  static Reference reference;
+  reference.vectors[0] = 0;
+  reference.starts[0] = now;
+  reference.count = 1;
+  unsigned long recognized = 0;
+  char label[40];
+  snprintf(label, sizeof(label), "%s with %u entries", name, LENGTH);
+  bool ok = runSteps(label, Reference::ENTRIES - 1, [&](int press)
+  {
+    // Mostly short taps of the same buttons, with some long holds.
+    uint8_t vector = (press & 1)? 0 : 1 << dice.below(3);
+    if (dice.below(4) == 0)
+      vector = dice.below(8);
+    unsigned long hold = 20 + ((dice.below(8) == 0)?
+                               dice.below(3000) : dice.below(400));
+    if (vector != reference.vector(0))
+    {
+      reference.vectors[reference.count] = vector;
+      reference.starts[reference.count++] = now;
+    }
+    recognizer.record(vector, now);
+    for (unsigned long end = now + hold; now < end; now += 7)
+    {
+      uint8_t got = recognizer.recognize(now);
+      uint8_t want = reference.recognize(table, COUNT, LENGTH, now);
+      if (got != want)
+      {
+        printf("gives %u instead of %u: ", got, want);
+        return false;
+      }
+      if (got)
+        recognized++;
+    }
+    return true;
+  });
+  if (!ok)
+    return false;
+  printf("%-7s with %u entries ok, %lu frames recognized\n",
+         name, LENGTH, recognized);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+int main()
+{
+  bool ok = check<6>("taps", Taps) && check<4>("taps", Taps) &&
+            check<2>("taps", Taps) && check<6>("windows", Windows) &&
+            check<3>("windows", Windows);
+  return ok? 0 : 1;
+}
@@ -0,0 +1,259 @@
+// Host check of the palette-indexed strand against a plain array of colors.
+//
+// check_palette.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// Random stores and scrolls of colors from a pool larger than the palette
+// are done on a NeoStrandIndexed, and on a plain array which keeps the
+// color each pixel should show.  A color must be stored exactly whenever
+// it, the colors on the strand, black and the last color matched all fit
+// in the palette together, since the entries no pixel uses are reclaimed
+// then.  Otherwise the pixel must get the nearest color on the strand.
+// After every step, each pixel must match the array, and so must the
+// bytes sent on the wire.  Scrolls which fade the trail are checked
+// against a strand of plain bytes.
+//
+
+#include "check.h"
+
+//----------------------------------------------------------------------------
+
+// The same distance the palette uses to find the nearest color.
+//
+static unsigned distance(uint32_t a, uint32_t b)
+{
+  unsigned sum = 0;
+  for (uint8_t shift = 0; shift < 32; shift += 8)
+  {
+    uint8_t x = a >> shift;
+    uint8_t y = b >> shift;
+    sum += (x > y)? x - y : y - x;
+  }
+  return sum;
+}
+
+// The pixels as the palette should have them, and the last color stored
+// with what it became, in the same places as the indexed strand's buffer.
+//
+struct Reference
+{
+  uint16_t length;
+  uint16_t colors;
+  bool ring;
+  uint32_t pixels[300];
+  uint32_t lastStored;
+  uint32_t lastShown;
+  bool nearest;
+
+  // The different colors which hold palette entries, the one being
+  // stored aside.
+  uint16_t inUse(uint32_t* found) const
+  {
+    uint16_t count = 0;
+    found[count++] = 0;
+    found[count++] = lastShown;
+    for (uint16_t i = 0; i < length; i++)
+      found[count++] = pixels[i];
+    uint16_t unique = 0;
+    for (uint16_t i = 0; i < count; i++)
+    {
+      uint16_t j = 0;
+      while (j < unique && found[j] != found[i])
+        j++;
+      if (j == unique)
+        found[unique++] = found[i];
+    }
+    return unique;
+  }
+
+  // Store a color, and check what the strand stored for it.
+  bool store(uint16_t n, uint32_t color, uint32_t got)
+  {
+    if (n >= length)
+      return true;
+    bool ok;
+    if (color == lastStored)
+      ok = (got == lastShown);
+    else if (got == color)
+      ok = true;
+    else
+    {
+      uint32_t found[302];
+      uint16_t unique = inUse(found);
+      unsigned best = 0xFFFF;
+      bool there = false;
+      for (uint16_t i = 0; i < unique; i++)
+      {
+        if (distance(found[i], color) < best)
+          best = distance(found[i], color);
+        there = there || (found[i] == got);
+      }
+      ok = (unique >= colors) && there && distance(got, color) == best;
+      nearest = nearest || ok;
+    }
+    pixels[n] = got;
+    lastStored = color;
+    lastShown = got;
+    return ok;
+  }
+
+  // Move the pixels along the way the buffer does:  in the ring, the
+  // pixels pushed off one end come round to the other, and otherwise they
+  // are left where they were, until the new color is stored over them.
+  void scroll(uint16_t amount, bool forward)
+  {
+    amount %= length;
+    uint32_t moved[300];
+    for (uint16_t i = 0; i < length; i++)
+    {
+      uint16_t from = forward? i + length - amount : i + amount;
+      moved[i] = pixels[from % length];
+      if (!ring && (forward? i < amount : i + amount >= length))
+        moved[i] = pixels[i];
+    }
+    memcpy(pixels, moved, length * sizeof(*pixels));
+  }
+};
+
+// Both the colors read back and the bytes sent, in GRB or GRBW order.
+//
+template <class S>
+static bool matches(S& strand, const Reference& reference, uint8_t stride)
+{
+  strand.show();
+  for (uint16_t n = 0; n < reference.length; n++)
+  {
+    uint32_t color = reference.pixels[n];
+    if (strand.getPixelColor(n) != color || sentColor(6, n, stride) != color)
+      return false;
+  }
+  return true;
+}
+
+template <uint16_t LENGTH, uint16_t COLORS, neoPixelType TYPE>
+static bool check(const char* name, bool ring, uint16_t pool)
+{
+  static NeoStrandIndexed<LENGTH, 6, TYPE + NEO_KHZ800, COLORS> strand;
+  uint8_t stride = (((TYPE >> 6) & 3) == ((TYPE >> 4) & 3))? 3 : 4;
+  uint32_t mask = (stride == 4)? 0xFFFFFFFF : 0xFFFFFF;
+  // Start from black, with black as the last color stored, and on the
+  // wire, since an unchanged frame is not sent again.
+  strand.clear();
+  strand.setRingBuffer(ring);
+  strand.setPixelColor(0, 0);
+  clearWire(6);
+  static Reference reference;
+  memset(&reference, 0, sizeof(reference));
+  reference.length = LENGTH;
+  reference.colors = COLORS;
+  reference.ring = ring;
+  static uint32_t colors[1000];
+  for (uint16_t i = 0; i < pool; i++)
+    colors[i] = randomColor(mask);
+  char label[40];
+  snprintf(label, sizeof(label), "%s of %u pixels with %u colors",
+           name, LENGTH, COLORS);
+  bool ok = runSteps(label, 3000, [&](int step)
+  {
+    uint32_t color = colors[dice.below(pool)];
+    uint16_t n = dice.below(LENGTH + 1);
+    uint16_t amount = dice.below(4) + 1;
+    bool ok = true;
+    switch (step % 4)
+    {
+    case 0:
+    case 1:
+      strand.setPixelColor(n, color);
+      ok = reference.store(n, color, strand.getPixelColor(n));
+      break;
+    case 2:
+      strand.scrollForward(amount, color);
+      reference.scroll(amount, true);
+      while (ok && amount--)
+        ok = reference.store(amount, color, strand.getPixelColor(amount));
+      break;
+    case 3:
+      strand.scrollBackward(amount, color);
+      reference.scroll(amount, false);
+      while (ok && amount--)
+        ok = reference.store(LENGTH - amount - 1, color,
+                             strand.getPixelColor(LENGTH - amount - 1));
+      break;
+    }
+    return ok && matches(strand, reference, stride);
+  });
+  if (!ok)
+    return false;
+  printf("%-4s %3u pixels, %3u colors, %4u in the pool, ring %-3s ok%s\n",
+         name, LENGTH, COLORS, pool, ring? "on" : "off",
+         reference.nearest? ", some nearest" : "");
+  return true;
+}
+
+// Fading scrolls fade the palette entries themselves, so they need no new
+// entries, and must give the same colors as a strand of plain bytes.
+//
+template <uint16_t LENGTH, uint16_t COLORS>
+static bool checkFading(bool ring)
+{
+  static NeoStrandIndexed<LENGTH, 6, NEO_GRB + NEO_KHZ800, COLORS> strand;
+  static NeoStrandT<LENGTH, 6> plain;
+  strand.clear();
+  plain.clear();
+  strand.setRingBuffer(ring);
+  plain.setRingBuffer(ring);
+  uint32_t colors[8];
+  for (uint8_t i = 0; i < countof(colors); i++)
+    colors[i] = randomColor(0xFFFFFF);
+  char label[40];
+  snprintf(label, sizeof(label), "fading %u pixels with %u colors",
+           LENGTH, COLORS);
+  bool ok = runSteps(label, 3000, [&](int step)
+  {
+    uint32_t color = colors[dice.below(countof(colors))];
+    uint16_t amount = dice.below(4) + 1;
+    uint8_t scale = 160 + dice.below(96);
+    if (step % 3)
+    {
+      strand.scrollForwardFading(amount, scale, color);
+      plain.scrollForwardFading(amount, scale, color);
+    }
+    else
+    {
+      strand.scrollForward(amount, color);
+      plain.scrollForward(amount, color);
+    }
+    for (uint16_t n = 0; n < LENGTH; n++)
+      if (strand.getPixelColor(n) != plain.getPixelColor(n))
+        return false;
+    return true;
+  });
+  if (!ok)
+    return false;
+  printf("fading %3u pixels, %3u colors, ring %-3s ok\n",
+         LENGTH, COLORS, ring? "on" : "off");
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+int main()
+{
+  bool ok = true;
+  for (int ring = 0; ok && ring < 2; ring++)
+  {
+    ok = check<60, 16, NEO_GRB>("GRB", ring, 12) &&
+         check<60, 16, NEO_GRB>("GRB", ring, 40) &&
+         check<60, 16, NEO_GRBW>("GRBW", ring, 40) &&
+         check<300, 256, NEO_GRB>("GRB", ring, 200) &&
+         check<300, 256, NEO_GRB>("GRB", ring, 900) &&
+         checkFading<60, 256>(ring) && checkFading<300, 256>(ring);
+  }
+  return ok? 0 : 1;
+}
@@ -0,0 +1,170 @@
+// Host check of the power budget against a plain recount of every pixel.
+//
+// check_power.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// Random stores, fills, scrolls and fades are done on each kind of strand,
+// with and without the ring buffer and gamma correction, under budgets
+// from far too little to plenty.  After every step, the running total of
+// channel levels must match a plain sum over the colors read back, and
+// each byte sent must be the gamma corrected byte, scaled by the limit
+// the plain sum calls for.  The current the bytes sent would draw must
+// then fit the budget.
+//
+
+#include "check.h"
+
+//----------------------------------------------------------------------------
+
+static const uint16_t Budgets[] = { 40, 100, 300, 1000, 5000 };
+
+static uint8_t scaled(uint8_t value, uint8_t scale)
+{
+  return ((uint16_t)value * scale + value) >> 8;
+}
+
+// The channel levels of every pixel, added up the plain way.
+//
+template <class S>
+static uint32_t levels(S& strand)
+{
+  uint32_t sum = 0;
+  for (uint16_t n = 0; n < strand.numPixels(); n++)
+  {
+    uint32_t c = strand.getPixelColor(n);
+    for (uint8_t shift = 0; shift < 32; shift += 8)
+      sum += (uint8_t)(c >> shift);
+  }
+  return sum;
+}
+
+// The limit the plain sum calls for:  none if the estimate fits, and
+// otherwise the largest which would scale the sum to fit, counted up one
+// at a time.  A byte scaled by s comes out as value*(s+1)/256.
+//
+static uint8_t limitFor(uint32_t sum, uint16_t pixels, uint16_t budget)
+{
+  if (budget <= pixels)
+    return 0;
+  uint64_t allowed = budget - pixels;
+  if (pixels + sum * 20 / 255 <= budget)
+    return 255;
+  uint8_t limit = 0;
+  while (limit < 254 && (uint64_t)sum * (limit + 2) * 20 <= allowed * 65280)
+    limit++;
+  return limit;
+}
+
+template <class S>
+static bool matches(S& strand, uint16_t budget, bool gamma, uint8_t stride)
+{
+  uint16_t length = strand.numPixels();
+  uint32_t sum = levels(strand);
+  if (strand.getPowerMilliamps() != length + sum * 20 / 255)
+    return false;
+  strand.show();
+  uint8_t limit = limitFor(sum, length, budget);
+  if (strand.getPowerLimit() != limit)
+    return false;
+  const uint8_t* sent = hostWire(6).bytes;
+  uint32_t drawn = 0;
+  for (uint16_t n = 0; n < length; n++, sent += stride)
+  {
+    uint32_t c = strand.getPixelColor(n);
+    uint8_t channels[4] = { (uint8_t)(c >> 8), (uint8_t)(c >> 16),
+                            (uint8_t)c, (uint8_t)(c >> 24) };
+    for (uint8_t i = 0; i < stride; i++)
+    {
+      uint8_t want = gamma? NeoStrand::Gamma(channels[i]) : channels[i];
+      if (sent[i] != scaled(want, limit))
+        return false;
+      drawn += sent[i];
+    }
+  }
+  return budget <= length || length + drawn * 20 / 255 <= budget;
+}
+
+template <class S>
+static bool check(const char* name, S& strand, uint8_t stride)
+{
+  bool gamma = false;
+  uint16_t budget = Budgets[0];
+  strand.setGamma(gamma);
+  strand.setPowerBudget(budget);
+  strand.clear();
+  clearWire(6);
+  uint16_t length = strand.numPixels();
+  uint32_t colors[40];
+  for (uint8_t i = 0; i < countof(colors); i++)
+    colors[i] = randomColor();
+  char label[40];
+  snprintf(label, sizeof(label), "%s of %u pixels", name, length);
+  bool ok = runSteps(label, 4000, [&](int)
+  {
+    uint32_t color = colors[dice.below(countof(colors))];
+    uint16_t first = dice.below(length + 2);
+    uint16_t count = dice.below(length + 2);
+    uint16_t amount = dice.below(6) + 1;
+    uint8_t scale = dice.below(256);
+    switch (dice.below(12))
+    {
+    case 0: case 1: case 2:
+      strand.setPixelColor(first, color);
+      break;
+    case 3: strand.scrollForward(amount, color); break;
+    case 4: strand.scrollBackward(amount, color); break;
+    case 5: strand.scrollForwardFading(amount, scale, color); break;
+    case 6: strand.scrollRangeForward(first, count, amount, color); break;
+    case 7: strand.scrollRangeBackward(first, count, amount, color); break;
+    case 8: strand.scaleRange(first, count, scale); break;
+    case 9: strand.fillRainbow(first, count, scale << 8, 1000); break;
+    case 10:
+      if (dice.below(8) == 0)
+        strand.wipeWithColor(color);
+      else
+        strand.setRingBuffer(!strand.isRingBuffer());
+      break;
+    case 11:
+      if (dice.below(2))
+        strand.setGamma(gamma = !gamma);
+      else
+        strand.setPowerBudget(budget = Budgets[dice.below(countof(Budgets))]);
+      break;
+    }
+    if (matches(strand, budget, gamma, stride))
+      return true;
+    printf("with a budget of %u mA: ", budget);
+    return false;
+  });
+  if (!ok)
+    return false;
+  printf("%-22s %3u pixels ok\n", name, length);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+int main()
+{
+  NeoStrand plain(60, 6, NEO_GRB + NEO_KHZ800);
+  NeoStrand plainGrbw(60, 6, NEO_GRBW + NEO_KHZ800);
+  static NeoStrandT<60, 6> fixed;
+  static NeoStrandT<150, 6, NEO_GRBW + NEO_KHZ800> fixedGrbw;
+  static NeoStrandIndexed<60, 6, NEO_GRB + NEO_KHZ800, 256> indexed;
+  static NeoStrandIndexed<150, 6, NEO_GRB + NEO_KHZ800, 16> indexed16;
+  plain.begin();
+  plainGrbw.begin();
+  bool ok = check("NeoStrand GRB", plain, 3) &&
+            check("NeoStrand GRBW", plainGrbw, 4) &&
+            check("NeoStrandT GRB", fixed, 3) &&
+            check("NeoStrandT GRBW", fixedGrbw, 4) &&
+            check("NeoStrandIndexed 256", indexed, 3) &&
+            check("NeoStrandIndexed 16", indexed16, 3);
+  return ok? 0 : 1;
+}
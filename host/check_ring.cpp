@@ -0,0 +1,203 @@
+// Host check of the ring buffer against a plain array of colors.
+//
+// check_ring.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// The same random stores and scrolls are done on a plain array, and on two
+// strands of each kind, one with the ring buffer and one without.  They
+// include scrolls of a run of pixels, which move them with moveRange(),
+// and may wrap around the end of a rotated buffer.  After every step each
+// pixel of both strands must match the array, and at the end, turning the
+// ring buffer off must leave the same bytes as the strand which never had
+// it.
+//
+
+#include "check.h"
+
+//----------------------------------------------------------------------------
+
+// What each operation should do, done the plain way, one pixel at a time.
+//
+struct Reference
+{
+  uint16_t length;
+  uint32_t colors[300];
+
+  void set(uint16_t n, uint32_t color)
+  {
+    if (n < length)
+      colors[n] = color;
+  }
+
+  void scrollRange(uint16_t first, uint16_t count, uint16_t amount,
+                   uint32_t color, bool forward)
+  {
+    if (first >= length)
+      return;
+    if (count > length - first)
+      count = length - first;
+    if (!count || !(amount %= count))
+      return;
+    uint32_t* run = colors + first;
+    if (forward)
+    {
+      for (uint16_t i = count; i-- > amount; )
+        run[i] = run[i - amount];
+      for (uint16_t i = 0; i < amount; i++)
+        run[i] = color;
+    }
+    else
+    {
+      for (uint16_t i = 0; i + amount < count; i++)
+        run[i] = run[i + amount];
+      for (uint16_t i = count - amount; i < count; i++)
+        run[i] = color;
+    }
+  }
+};
+
+template <class S>
+static bool matches(S& strand, const Reference& reference, uint32_t mask)
+{
+  for (uint16_t n = 0; n < reference.length; n++)
+    if (strand.getPixelColor(n) != (reference.colors[n] & mask))
+      return false;
+  return true;
+}
+
+template <class S>
+static bool check(const char* name, S& ring, S& flat, uint32_t mask)
+{
+  Reference reference;
+  reference.length = ring.numPixels();
+  memset(reference.colors, 0, sizeof(reference.colors));
+  ring.setRingBuffer(true);
+  flat.setRingBuffer(false);
+  uint16_t length = reference.length;
+  char label[40];
+  snprintf(label, sizeof(label), "%s of %u pixels", name, length);
+  bool ok = runSteps(label, 5000, [&](int step)
+  {
+    uint32_t color = randomColor();
+    uint16_t first = dice.below(length + 2);
+    uint16_t count = dice.below(length + 2);
+    uint16_t amount = dice.below(length + 3);
+    S* strands[] = { &ring, &flat };
+    for (uint8_t s = 0; s < 2; s++)
+    {
+      S& strand = *strands[s];
+      switch (step % 6)
+      {
+      case 0: strand.scrollForward(amount, color); break;
+      case 1: strand.scrollBackward(amount, color); break;
+      case 2: strand.setPixelColor(first, color); break;
+      case 3: strand.scrollRangeForward(first, count, amount, color); break;
+      case 4: strand.scrollRangeBackward(first, count, amount, color); break;
+      case 5: strand.fill(color, first, count); break;
+      }
+    }
+    switch (step % 6)
+    {
+    case 0: reference.scrollRange(0, length, amount, color, true); break;
+    case 1: reference.scrollRange(0, length, amount, color, false); break;
+    case 2: reference.set(first, color); break;
+    case 3: reference.scrollRange(first, count, amount, color, true); break;
+    case 4: reference.scrollRange(first, count, amount, color, false); break;
+    case 5:
+      for (uint16_t n = first; n < length && (!count || n < first + count); n++)
+        reference.set(n, color);
+      break;
+    }
+    return matches(ring, reference, mask) && matches(flat, reference, mask);
+  });
+  if (!ok)
+    return false;
+  ring.setRingBuffer(false);
+  uint16_t bytes = length * ((mask == 0xFFFFFF)? 3 : 4);
+  if (memcmp(ring.getPixels(), flat.getPixels(), bytes))
+  {
+    printf("%s of %u pixels is not put back in order\n", name, length);
+    return false;
+  }
+  return true;
+}
+
+// The original fill() stored straight into the buffer, so a frame which
+// was only filled was never sent.  Each fill must reach the wire.  The
+// ring is scrolled first, so most frames wrap around the end of the
+// buffer, and each must still go out in a single show().
+//
+template <class S>
+static bool checkFill(const char* name, S& strand, uint32_t mask)
+{
+  Reference reference;
+  reference.length = strand.numPixels();
+  memset(reference.colors, 0, sizeof(reference.colors));
+  uint16_t length = reference.length;
+  uint8_t stride = (mask == 0xFFFFFF)? 3 : 4;
+  strand.clear();
+  strand.setRingBuffer(true);
+  strand.show();
+  clearWire(6);
+  char label[40];
+  snprintf(label, sizeof(label), "%s fill of %u pixels", name, length);
+  return runSteps(label, 200, [&](int step)
+  {
+    uint32_t color = randomColor(mask);
+    uint16_t first = (step % 4)? dice.below(length + 1) : 0;
+    uint16_t count = (step % 4)? dice.below(length + 2) : 0;
+    uint16_t amount = dice.below(length + 1);
+    strand.scrollForward(amount);
+    reference.scrollRange(0, length, amount, 0, true);
+    strand.fill(color, first, count);
+    uint16_t end = (count && first + count < length)? first + count : length;
+    for (uint16_t n = first; n < end; n++)
+      reference.set(n, color);
+    unsigned long shows = hostWire(6).shows;
+    strand.show();
+    if (hostWire(6).shows > shows + 1)
+      return false;
+    for (uint16_t n = 0; n < length; n++)
+      if (sentColor(6, n, stride) != reference.colors[n])
+        return false;
+    return true;
+  });
+}
+
+template <uint16_t LENGTH>
+static bool checkLength()
+{
+  NeoStrand grb(LENGTH, 6, NEO_GRB + NEO_KHZ800);
+  NeoStrand grbFlat(LENGTH, 6, NEO_GRB + NEO_KHZ800);
+  NeoStrand grbw(LENGTH, 6, NEO_GRBW + NEO_KHZ800);
+  NeoStrand grbwFlat(LENGTH, 6, NEO_GRBW + NEO_KHZ800);
+  static NeoStrandT<LENGTH, 6> fixed;
+  static NeoStrandT<LENGTH, 6> fixedFlat;
+  static NeoStrandT<LENGTH, 6, NEO_GRBW + NEO_KHZ800> fixedGrbw;
+  static NeoStrandT<LENGTH, 6, NEO_GRBW + NEO_KHZ800> fixedGrbwFlat;
+  bool ok = check("NeoStrand GRB", grb, grbFlat, 0xFFFFFF) &&
+            check("NeoStrand GRBW", grbw, grbwFlat, 0xFFFFFFFF) &&
+            check("NeoStrandT GRB", fixed, fixedFlat, 0xFFFFFF) &&
+            check("NeoStrandT GRBW", fixedGrbw, fixedGrbwFlat, 0xFFFFFFFF) &&
+            checkFill("NeoStrand GRB", grb, 0xFFFFFF) &&
+            checkFill("NeoStrand GRBW", grbw, 0xFFFFFFFF) &&
+            checkFill("NeoStrandT GRB", fixed, 0xFFFFFF);
+  if (ok)
+    printf("%4u pixels ok\n", LENGTH);
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+
+int main()
+{
+  bool ok = checkLength<1>() && checkLength<7>() && checkLength<60>() &&
+            checkLength<161>() && checkLength<300>();
+  return ok? 0 : 1;
+}
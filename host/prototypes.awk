@@ -0,0 +1,58 @@
+# Turn an Arduino sketch into a C++ file that an ordinary compiler takes.
+#
+# prototypes.awk
+# Copyright (c) by Ed Halley and Jaime Halley
+#
+# This file is licensed under a
+# Creative Commons Attribution-ShareAlike 4.0 International License.
+#
+# You should have received a copy of the license along with this
+# work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+#
+# The Arduino IDE lets a sketch call a function before it is defined, by
+# adding a prototype for every function ahead of the first one.  This does
+# the same for sketches written in the NeoStrand style, where each
+# function starts at the left margin and its opening brace is on the next
+# line by itself.  The sketch is read twice:  once to find the functions,
+# and again to copy it out with Arduino.h first and the prototypes added.
+# A #line directive keeps the compiler's messages pointing at the sketch.
+#
+#   awk -f prototypes.awk NeoStrand.ino NeoStrand.ino > NeoStrand.cpp
+#
+
+FNR == 1 { pass++ }
+
+pass == 1 && !open && signature != "" {
+  if ($0 == "{")
+  {
+    gsub(/ *= *[^,)]+/, "", signature)
+    prototypes = prototypes signature ";\n"
+    if (!first)
+      first = start
+  }
+  signature = ""
+}
+
+pass == 1 && !open && /^[A-Za-z_][A-Za-z0-9_<>: *&]*[ *&][A-Za-z_][A-Za-z0-9_]* *\(/ && !/;/ {
+  signature = $0
+  start = FNR
+  open = !/\)$/
+  next
+}
+
+pass == 1 && open {
+  sub(/^ +/, " ")
+  signature = signature $0
+  open = !/\)$/
+  next
+}
+
+pass == 2 && FNR == 1 {
+  printf "#include \"Arduino.h\"\n#line 1 \"%s\"\n", FILENAME
+}
+
+pass == 2 && FNR == first {
+  printf "%s#line %d \"%s\"\n", prototypes, FNR, FILENAME
+}
+
+pass == 2 { print }
@@ -0,0 +1,319 @@
+// Host simulator for the NeoStrand sketch.
+//
+// simulate.cpp
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+// The sketch itself is compiled unchanged against the stand-in Arduino
+// core and Adafruit_NeoPixel library in stubs/ (see prototypes.awk), and
+// this runs its setup() and loop() on the virtual clock.  A script presses
+// and releases the buttons and turns the dimmer at given times, and the
+// strand is captured at a steady rate of virtual time, to draw in the
+// terminal or to save as a PPM image with one row per capture, so the
+// waterfall runs down the page.  Nothing waits for real time, so ten
+// seconds of effects take a small fraction of a second.
+//
+//   build/simulate -s 5 -a demo.script
+//   build/simulate -o build/demo.ppm demo.script
+//
+// A script has one event per line:  the time in milliseconds since power
+// on, then what happens.  Blank lines and anything after a # are ignored.
+//
+//   500   press luka         # or twin, miku, debug, or a pin number
+//   800   release luka
+//   1200  press luka twin    # a combination, pressed together
+//   2000  dimmer 512         # the knob, 0~1023
+//
+
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <vector>
+
+#include "Arduino.h"
+#include "Adafruit_NeoPixel.h"
+
+void setup();
+void loop();
+
+//----------------------------------------------------------------------------
+
+// The buttons wired up in NeoStrand.ino.
+//
+static const struct
+{
+  const char* name;
+  uint8_t pin;
+}
+buttonPins[] =
+{
+  { "luka", 9 },
+  { "twin", 8 },
+  { "miku", 7 },
+  { "debug", 4 },
+};
+
+struct Event
+{
+  unsigned long micros;
+  enum { PRESS, RELEASE, DIMMER } action;
+  int value;
+};
+
+static std::vector<Event> script;
+static size_t nextEvent = 0;
+static unsigned long clockReads = 0;
+
+// A button pulls its pin low while pressed; the pull-up holds the others
+// high.
+//
+static void setButton(uint8_t pin, bool pressed)
+{
+  volatile uint8_t* input = portInputRegister(digitalPinToPort(pin));
+  if (pressed)
+    *input &= ~digitalPinToBitMask(pin);
+  else
+    *input |= digitalPinToBitMask(pin);
+}
+
+// Called whenever the virtual clock moves, so each event happens at its
+// time, even in the middle of a loop() that is waiting for it.
+//
+static void onClock(unsigned long now)
+{
+  clockReads++;
+  while (nextEvent < script.size() && script[nextEvent].micros <= now)
+  {
+    const Event& event = script[nextEvent++];
+    if (event.action == Event::DIMMER)
+      hostAnalog(A0) = event.value;
+    else
+      setButton(event.value, event.action == Event::PRESS);
+  }
+}
+
+static bool findButton(const char* word, int& pin)
+{
+  for (unsigned i = 0; i < sizeof(buttonPins) / sizeof(*buttonPins); i++)
+    if (!strcmp(word, buttonPins[i].name))
+    {
+      pin = buttonPins[i].pin;
+      return true;
+    }
+  char* end;
+  pin = strtol(word, &end, 10);
+  return *word && !*end && pin >= 0 && pin < 20;
+}
+
+static bool readScript(const char* path)
+{
+  FILE* file = strcmp(path, "-")? fopen(path, "r") : stdin;
+  if (!file)
+  {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  int number = 0;
+  unsigned long last = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), file))
+  {
+    number++;
+    char* hash = strchr(line, '#');
+    if (hash)
+      *hash = 0;
+    char* word = strtok(line, " \t\r\n");
+    if (!word)
+      continue;
+    Event event;
+    event.micros = strtoul(word, NULL, 10) * 1000;
+    char* action = strtok(NULL, " \t\r\n");
+    char* arg = strtok(NULL, " \t\r\n");
+    ok = action && arg && event.micros >= last;
+    if (ok && !strcmp(action, "dimmer"))
+    {
+      event.action = Event::DIMMER;
+      event.value = constrain(atoi(arg), 0, 1023);
+      script.push_back(event);
+    }
+    else if (ok && (!strcmp(action, "press") || !strcmp(action, "release")))
+    {
+      event.action = (action[0] == 'p')? Event::PRESS : Event::RELEASE;
+      for (; ok && arg; arg = strtok(NULL, " \t\r\n"))
+        if ((ok = findButton(arg, event.value)))
+          script.push_back(event);
+    }
+    else
+      ok = false;
+    last = event.micros;
+  }
+  if (!ok)
+    fprintf(stderr, "%s:%d: can't understand this event\n", path, number);
+  if (file != stdin)
+    fclose(file);
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+
+// Draw one capture as a row of colored spaces.
+//
+static void drawRow(const uint8_t* rgb, uint16_t count)
+{
+  for (uint16_t i = 0; i < count; i++, rgb += 3)
+    printf("\033[48;2;%u;%u;%um ", rgb[0], rgb[1], rgb[2]);
+  printf("\033[0m\n");
+}
+
+static bool writeImage(const char* path, const std::vector<uint8_t>& rows,
+                       uint16_t width)
+{
+  FILE* file = fopen(path, "wb");
+  if (!file)
+  {
+    perror(path);
+    return false;
+  }
+  fprintf(file, "P6\n%u %u\n255\n", width, (unsigned)(rows.size() / (width * 3)));
+  fwrite(rows.data(), 1, rows.size(), file);
+  fclose(file);
+  return true;
+}
+
+// How long one read of the clock takes on this host, so the time loop()
+// spends waiting for its next frame can be left out of its running time.
+// This has to be measured before the script is read.
+//
+static double clockReadNanos()
+{
+  typedef std::chrono::steady_clock clock;
+  const long reads = 1000000;
+  unsigned long saved = hostMicros();
+  clock::time_point start = clock::now();
+  for (long i = 0; i < reads; i++)
+    micros();
+  clock::duration total = clock::now() - start;
+  hostMicros() = saved;
+  clockReads = 0;
+  return std::chrono::duration<double, std::nano>(total).count() / reads;
+}
+
+static void usage()
+{
+  fprintf(stderr,
+    "usage: simulate [-s seconds] [-e ms] [-a] [-o image.ppm] [-p pin]\n"
+    "                [-n pixels] [script]\n"
+    "  -s seconds   how long to run, in virtual time (default 10)\n"
+    "  -e ms        capture the strand this often (default 20)\n"
+    "  -a           draw each capture in the terminal\n"
+    "  -o file      save the captures as a PPM image, one row each\n"
+    "  -p pin       the strand's data pin (default 11)\n"
+    "  -n pixels    how many pixels to capture (default: all that were sent)\n"
+    "  script       button and dimmer events, or - for standard input\n");
+}
+
+//----------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  double seconds = 10;
+  unsigned long every = 20;
+  bool ansi = false;
+  const char* image = NULL;
+  int pin = 11;
+  int pixels = 0;
+  int option;
+  while ((option = getopt(argc, argv, "s:e:ao:p:n:h")) != -1)
+  {
+    switch (option)
+    {
+      case 's': seconds = atof(optarg); break;
+      case 'e': every = strtoul(optarg, NULL, 10); break;
+      case 'a': ansi = true; break;
+      case 'o': image = optarg; break;
+      case 'p': pin = atoi(optarg); break;
+      case 'n': pixels = atoi(optarg); break;
+      default: usage(); return 1;
+    }
+  }
+  if (optind < argc - 1 || !every || pin < 0 || pin >= 20)
+  {
+    usage();
+    return 1;
+  }
+  hostClockHook() = onClock;
+  double readNanos = clockReadNanos();
+  if (optind < argc && !readScript(argv[optind]))
+    return 1;
+
+  // Nothing is pressed, and the dimmer is turned all the way up.
+  PINB = PINC = PIND = 0xFF;
+  hostAnalog(A0) = 1023;
+
+  typedef std::chrono::steady_clock clock;
+  clock::time_point started = clock::now();
+  setup();
+
+  // The first frame after setup() sends the whole strand.
+  HostWire& wire = hostWire(pin);
+  uint16_t width = pixels? pixels : wire.length / 3;
+  if (width > HostWire::BYTES / 3)
+    width = HostWire::BYTES / 3;
+  std::vector<uint8_t> rows;
+  std::vector<uint8_t> row(width * 3);
+
+  unsigned long end = (unsigned long)(seconds * 1000000);
+  unsigned long nextCapture = hostMicros();
+  unsigned long loops = 0;
+  double busyNanos = 0;
+  double maxBusyNanos = 0;
+  while (hostMicros() < end)
+  {
+    unsigned long reads = clockReads;
+    clock::time_point start = clock::now();
+    loop();
+    double nanos = std::chrono::duration<double, std::nano>(
+      clock::now() - start).count();
+    nanos -= (clockReads - reads) * readNanos;
+    if (nanos < 0)
+      nanos = 0;
+    busyNanos += nanos;
+    if (nanos > maxBusyNanos)
+      maxBusyNanos = nanos;
+    loops++;
+
+    // The strand is sent green, red, blue.
+    for (; nextCapture <= hostMicros(); nextCapture += every * 1000)
+    {
+      for (uint16_t i = 0; i < width; i++)
+      {
+        row[i*3 + 0] = wire.bytes[i*3 + 1];
+        row[i*3 + 1] = wire.bytes[i*3 + 0];
+        row[i*3 + 2] = wire.bytes[i*3 + 2];
+      }
+      if (ansi)
+        drawRow(row.data(), width);
+      if (image)
+        rows.insert(rows.end(), row.begin(), row.end());
+    }
+  }
+  double real = std::chrono::duration<double>(clock::now() - started).count();
+
+  if (image && !writeImage(image, rows, width))
+    return 1;
+
+  double virtualSeconds = hostMicros() / 1e6;
+  printf("simulated %.3f s in %.3f s (%.0fx realtime)\n",
+         virtualSeconds, real, virtualSeconds / real);
+  printf("loop() ran %lu times, busy %.2f us mean, %.2f us max on this host\n",
+         loops, loops? busyNanos / loops / 1000 : 0, maxBusyNanos / 1000);
+  printf("pin %d sent %lu frames of up to %u pixels\n",
+         pin, wire.frames, wire.length / 3);
+  return 0;
+}
@@ -0,0 +1,250 @@
+// Stand-in for the Adafruit_NeoPixel library, for building NeoStrand code
+// on a host.
+//
+// Adafruit_NeoPixel.h (host stub)
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+
+#ifndef __HOST_ADAFRUIT_NEOPIXEL_H__
+#define __HOST_ADAFRUIT_NEOPIXEL_H__
+
+#include "Arduino.h"
+
+//----------------------------------------------------------------------------
+
+// The same pixel type constants, class layout and protected members as
+// the real library, so NeoStrand compiles against it unchanged.  Pixel
+// storage and color packing behave exactly like the original; show()
+// just accounts for the time the real transmission would take.
+//
+
+#define NEO_RGB  ((0<<6) | (0<<4) | (1<<2) | (2))
+#define NEO_RBG  ((0<<6) | (0<<4) | (2<<2) | (1))
+#define NEO_GRB  ((1<<6) | (1<<4) | (0<<2) | (2))
+#define NEO_GBR  ((2<<6) | (2<<4) | (0<<2) | (1))
+#define NEO_BRG  ((1<<6) | (1<<4) | (2<<2) | (0))
+#define NEO_BGR  ((2<<6) | (2<<4) | (1<<2) | (0))
+#define NEO_RGBW ((3<<6) | (0<<4) | (1<<2) | (2))
+#define NEO_GRBW ((3<<6) | (1<<4) | (0<<2) | (2))
+#define NEO_KHZ800 0x0000
+#define NEO_KHZ400 0x0100
+
+typedef uint16_t neoPixelType;
+
+// What the pixels on each pin have been sent, so a simulation can look at
+// them.  The data shifts into the pixels from the first one on, and when
+// the line has been idle for 50us they latch, so the next data starts
+// again at the first pixel.  Pixels keep their bytes until new ones come,
+// so a frame shorter than the strand leaves the rest as they were.
+//
+struct HostWire
+{
+  enum { BYTES = 4096 };
+  uint8_t bytes[BYTES];
+  uint16_t length;          // the most bytes any frame has reached
+  uint16_t position;        // where the next byte of this frame goes
+  unsigned long idleSince;  // when the line last went idle
+  unsigned long frames;     // how many frames have been started
+  unsigned long shows;      // how many times show() has sent bytes
+};
+
+inline HostWire& hostWire(uint8_t pin)
+{
+  static HostWire wires[20];
+  return wires[pin % 20];
+}
+
+class Adafruit_NeoPixel
+{
+public:
+  Adafruit_NeoPixel(uint16_t n, uint8_t p=6, neoPixelType t=NEO_GRB + NEO_KHZ800) :
+    begun(false), numLEDs(0), numBytes(0), brightness(0), pixels(NULL),
+    rOffset(1), wOffset(1), endTime(0)
+  {
+    updateType(t);
+    updateLength(n);
+    setPin(p);
+  }
+  Adafruit_NeoPixel(void) :
+    is800KHz(true), begun(false), numLEDs(0), numBytes(0), pin(-1),
+    brightness(0), pixels(NULL), rOffset(1), gOffset(0), bOffset(2),
+    wOffset(1), endTime(0) { ; }
+  ~Adafruit_NeoPixel() { if (pixels) free(pixels); }
+
+  void begin(void) { begun = true; }
+  void setPin(uint8_t p) { pin = p; }
+
+  // Each bit takes 1.25us at 800KHz, or 2.5us at 400KHz.
+  void show(void)
+  {
+    if (!pixels)
+      return;
+    while (!canShow())
+      hostMicros()++;
+    HostWire& wire = hostWire(pin);
+    wire.shows++;
+    if (hostMicros() - wire.idleSince >= 50)
+    {
+      wire.position = 0;
+      wire.frames++;
+    }
+    for (uint16_t i = 0; i < numBytes && wire.position < HostWire::BYTES; i++)
+      wire.bytes[wire.position++] = pixels[i];
+    if (wire.position > wire.length)
+      wire.length = wire.position;
+    hostAdvance(numBytes * (is800KHz? 10 : 20));
+    wire.idleSince = hostMicros();
+    endTime = micros();
+  }
+
+  bool canShow(void) { return (micros() - endTime) >= 300L; }
+
+  void updateLength(uint16_t n)
+  {
+    if (pixels)
+      free(pixels);
+    numBytes = n * ((wOffset == rOffset)? 3 : 4);
+    if ((pixels = (uint8_t*)calloc(numBytes, 1)))
+      numLEDs = n;
+    else
+      numLEDs = numBytes = 0;
+  }
+
+  void updateType(neoPixelType t)
+  {
+    bool oldThreeBytesPerPixel = (wOffset == rOffset);
+    wOffset = (t >> 6) & 3;
+    rOffset = (t >> 4) & 3;
+    gOffset = (t >> 2) & 3;
+    bOffset = t & 3;
+    is800KHz = (t < 256);
+    if (pixels && (wOffset == rOffset) != oldThreeBytesPerPixel)
+      updateLength(numLEDs);
+  }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b)
+  {
+    if (n >= numLEDs)
+      return;
+    if (brightness)
+    {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+    }
+    uint8_t* p;
+    if (wOffset == rOffset)
+      p = &pixels[n * 3];
+    else
+    {
+      p = &pixels[n * 4];
+      p[wOffset] = 0;
+    }
+    p[rOffset] = r;
+    p[gOffset] = g;
+    p[bOffset] = b;
+  }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+  {
+    if (n >= numLEDs)
+      return;
+    if (brightness)
+    {
+      r = (r * brightness) >> 8;
+      g = (g * brightness) >> 8;
+      b = (b * brightness) >> 8;
+      w = (w * brightness) >> 8;
+    }
+    uint8_t* p;
+    if (wOffset == rOffset)
+      p = &pixels[n * 3];
+    else
+    {
+      p = &pixels[n * 4];
+      p[wOffset] = w;
+    }
+    p[rOffset] = r;
+    p[gOffset] = g;
+    p[bOffset] = b;
+  }
+
+  void setPixelColor(uint16_t n, uint32_t c)
+  {
+    setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c,
+                  (uint8_t)(c >> 24));
+  }
+
+  uint32_t getPixelColor(uint16_t n) const
+  {
+    if (n >= numLEDs)
+      return 0;
+    const uint8_t* p = &pixels[n * ((wOffset == rOffset)? 3 : 4)];
+    uint8_t w = (wOffset == rOffset)? 0 : p[wOffset];
+    if (!brightness)
+      return Color(p[rOffset], p[gOffset], p[bOffset], w);
+    return Color((p[rOffset] << 8) / brightness,
+                 (p[gOffset] << 8) / brightness,
+                 (p[bOffset] << 8) / brightness,
+                 (w << 8) / brightness);
+  }
+
+  void setBrightness(uint8_t b)
+  {
+    uint8_t newBrightness = b + 1;
+    if (newBrightness == brightness)
+      return;
+    uint8_t oldBrightness = brightness - 1;
+    uint16_t scale;
+    if (oldBrightness == 0)
+      scale = 0;
+    else if (b == 255)
+      scale = 65535 / oldBrightness;
+    else
+      scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
+    for (uint16_t i = 0; i < numBytes; i++)
+      pixels[i] = (pixels[i] * scale) >> 8;
+    brightness = newBrightness;
+  }
+
+  void fill(uint32_t c = 0, uint16_t first = 0, uint16_t count = 0)
+  {
+    if (first >= numLEDs)
+      return;
+    uint16_t end = (count && count < numLEDs - first)? first + count : numLEDs;
+    for (uint16_t i = first; i < end; i++)
+      setPixelColor(i, c);
+  }
+
+  void clear(void) { memset(pixels, 0, numBytes); }
+  uint8_t* getPixels(void) const { return pixels; }
+  uint8_t getBrightness(void) const { return brightness - 1; }
+  int8_t getPin(void) { return pin; }
+  uint16_t numPixels(void) const { return numLEDs; }
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b)
+  {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+  {
+    return ((uint32_t)w << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+protected:
+  bool is800KHz, begun;
+  uint16_t numLEDs, numBytes;
+  int8_t pin;
+  uint8_t brightness, *pixels, rOffset, gOffset, bOffset, wOffset;
+  uint32_t endTime;
+};
+
+//----------------------------------------------------------------------------
+
+#endif // __HOST_ADAFRUIT_NEOPIXEL_H__
@@ -0,0 +1,232 @@
+// Stand-in for the Arduino core, for building NeoStrand code on a host.
+//
+// Arduino.h (host stub)
+// Copyright (c) by Ed Halley and Jaime Halley
+//
+// This file is licensed under a
+// Creative Commons Attribution-ShareAlike 4.0 International License.
+//
+// You should have received a copy of the license along with this
+// work. If not, see <http://creativecommons.org/licenses/by-sa/4.0/>.
+//
+
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+//----------------------------------------------------------------------------
+
+// The host has no timers of its own to drive millis() and micros(), so
+// time is virtual:  it only moves forward when something waits for it,
+// such as delay(), or when a stub (like show()) knows how long the real
+// hardware would have been busy.  Reading the clock also moves it on by
+// a microsecond, about what the read takes on a 16MHz AVR, so a loop
+// which keeps reading the clock until some time comes does get there.
+//
+// A simulation can set a hook which is called whenever the clock moves,
+// to change the inputs at the right moments (see simulate.cpp).
+//
+inline unsigned long& hostMicros()
+{
+  static unsigned long now = 0;
+  return now;
+}
+
+typedef void (*HostClockHook)(unsigned long now);
+
+inline HostClockHook& hostClockHook()
+{
+  static HostClockHook hook = NULL;
+  return hook;
+}
+
+inline void hostAdvance(unsigned long us)
+{
+  hostMicros() += us;
+  if (hostClockHook())
+    hostClockHook()(hostMicros());
+}
+
+inline unsigned long micros()
+{
+  unsigned long now = hostMicros();
+  hostAdvance(1);
+  return now;
+}
+inline unsigned long millis() { return micros() / 1000; }
+inline void delayMicroseconds(unsigned int us) { hostAdvance(us); }
+inline void delay(unsigned long ms) { hostAdvance(ms * 1000); }
+
+//----------------------------------------------------------------------------
+
+// Pins and ports, laid out like an ATmega328, with nothing attached.  The
+// port registers are plain variables.
+//
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define NOT_A_PIN 0
+#define A0 14
+
+inline volatile uint8_t& hostRegister(int n)
+{
+  static volatile uint8_t registers[9];
+  return registers[n];
+}
+
+#define PINB hostRegister(0)
+#define DDRB hostRegister(1)
+#define PORTB hostRegister(2)
+#define PINC hostRegister(3)
+#define DDRC hostRegister(4)
+#define PORTC hostRegister(5)
+#define PIND hostRegister(6)
+#define DDRD hostRegister(7)
+#define PORTD hostRegister(8)
+
+inline uint8_t digitalPinToPort(uint8_t pin)
+{
+  return (pin < 8)? 4 : (pin < 14)? 2 : (pin < 20)? 3 : NOT_A_PIN;
+}
+inline uint8_t digitalPinToBitMask(uint8_t pin)
+{
+  return 1 << ((pin < 8)? pin : (pin < 14)? pin - 8 : pin - 14);
+}
+inline volatile uint8_t* portRegisters(uint8_t port)
+{
+  return &hostRegister((port == 2)? 0 : (port == 3)? 3 : 6);
+}
+inline volatile uint8_t* portInputRegister(uint8_t port) { return portRegisters(port); }
+inline volatile uint8_t* portModeRegister(uint8_t port) { return portRegisters(port) + 1; }
+inline volatile uint8_t* portOutputRegister(uint8_t port) { return portRegisters(port) + 2; }
+
+inline int digitalRead(uint8_t pin)
+{
+  uint8_t port = digitalPinToPort(pin);
+  return (*portInputRegister(port) & digitalPinToBitMask(pin))? 1 : 0;
+}
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+  uint8_t port = digitalPinToPort(pin);
+  if (mode == OUTPUT)
+    *portModeRegister(port) |= digitalPinToBitMask(pin);
+  else
+    *portModeRegister(port) &= ~digitalPinToBitMask(pin);
+}
+inline void digitalWrite(uint8_t pin, uint8_t value)
+{
+  uint8_t port = digitalPinToPort(pin);
+  if (value)
+    *portOutputRegister(port) |= digitalPinToBitMask(pin);
+  else
+    *portOutputRegister(port) &= ~digitalPinToBitMask(pin);
+}
+
+// The analog inputs are plain variables too, 0~1023, which a simulation
+// can set.  Like the real analogRead(), this takes either 0~5 or A0~A5.
+//
+inline int& hostAnalog(uint8_t channel)
+{
+  static int inputs[6];
+  return inputs[(channel >= A0)? (channel - A0) % 6 : channel % 6];
+}
+inline int analogRead(uint8_t pin) { return hostAnalog(pin); }
+
+inline void noInterrupts() { ; }
+inline void interrupts() { ; }
+
+#define bit(b) (1UL << (b))
+#define constrain(amt, low, high) \
+  ((amt) < (low)? (low) : ((amt) > (high)? (high) : (amt)))
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define memcpy_P memcpy
+
+//----------------------------------------------------------------------------
+
+// The same random number generator as avr-libc's random(), with the same
+// divisions, wrapped the same way as the Arduino core.
+//
+inline unsigned long& hostRandomState()
+{
+  static unsigned long state = 1;
+  return state;
+}
+
+inline long random()
+{
+  long x = hostRandomState();
+  if (x == 0)
+    x = 123459876L;
+  long hi = x / 127773L;
+  long lo = x % 127773L;
+  x = 16807L * lo - 2836L * hi;
+  if (x < 0)
+    x += 0x7FFFFFFFL;
+  hostRandomState() = x;
+  return x % 0x80000000UL;
+}
+
+inline long random(long howbig)
+{
+  if (howbig == 0)
+    return 0;
+  return random() % howbig;
+}
+
+inline long random(long howsmall, long howbig)
+{
+  if (howsmall >= howbig)
+    return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+inline void randomSeed(unsigned long seed)
+{
+  if (seed != 0)
+    hostRandomState() = seed;
+}
+
+//----------------------------------------------------------------------------
+
+// The serial port prints to the standard error, so it doesn't get mixed
+// up with a simulation's own output.
+//
+struct HostSerial
+{
+  void begin(unsigned long) { ; }
+  void print(const char* s) { fputs(s, stderr); }
+  void print(char c) { fputc(c, stderr); }
+  void print(int n) { fprintf(stderr, "%d", n); }
+  void print(unsigned int n) { fprintf(stderr, "%u", n); }
+  void print(long n) { fprintf(stderr, "%ld", n); }
+  void print(unsigned long n) { fprintf(stderr, "%lu", n); }
+  void println(const char* s) { fprintf(stderr, "%s\n", s); }
+};
+
+inline HostSerial& hostSerial()
+{
+  static HostSerial serial;
+  return serial;
+}
+
+#define Serial hostSerial()
+
+//----------------------------------------------------------------------------
+
+#endif // __HOST_ARDUINO_H__